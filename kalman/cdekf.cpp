@@ -0,0 +1,332 @@
+/**
+ * @file cdekf.cpp
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Continuous-discrete extended Kalman filter implementation, for a nonlinear system.
+ */
+
+#include "cdekf.h"
+
+CDEKF::CDEKF()
+{
+  noiseGenerator_ = 0;
+}
+
+CDEKF::~CDEKF()
+{
+
+}
+
+void CDEKF::InitSystem(int n_states, int n_outputs, const mat& Qc, const mat& R, double dt)
+{
+  assert(Qc.is_square() && "Whoops, Qc must be a square matrix");
+  assert(R.is_square() && "Whoops, R must be a square matrix (n_outputs x n_outputs)");
+  assert(dt > 0 && "Whoops, dt must be positive");
+
+  // Epsilon for computing the Jacobian numerically
+  epsilon_= 1e-8;
+
+  // Default tolerances of the integrator
+  relTol_ = 1e-6;
+  absTol_ = 1e-9;
+
+  nStates_ = n_states;
+  nOutputs_ = n_outputs;
+
+  dt_ = dt;
+  h0_ = dt;
+  nSteps_ = 0;
+
+  Qc_ = Qc;
+  R_ = R;
+
+  // Cholesky factors of the noise covariances, the process noise accumulates over dt
+  mat Q = Qc_ * dt_;
+  NoiseGenerator::CovarianceFactor(Q, sqrt_Q_);
+  NoiseGenerator::CovarianceFactor(R_, sqrt_R_);
+
+  A_.resize(n_states, n_states);
+  H_.resize(n_outputs, n_states);
+
+  x_p_.resize(n_states);
+  x_m_.resize(n_states);
+
+  P_p_.resize(n_states, n_states);
+  P_m_.resize(n_states, n_states);
+
+  v_.resize(n_states);
+  w_.resize(n_outputs);
+
+  z_.resize(n_outputs);
+  z_m_.resize(n_outputs);
+
+  factor_.SetSize(n_states, n_outputs);
+
+  // Apply intial states
+  x_.resize(n_states);
+  x_ = x_.zeros();
+
+  // Inital values for the Kalman iterations
+  P_m_ = P_m_.eye();
+  x_m_ = x_m_.zeros();
+}
+
+colvec CDEKF::dfdt(const colvec &x, const colvec &u)
+{
+  colvec dx(nStates_);
+  dx = dx.zeros();
+  return dx;
+}
+
+colvec CDEKF::h(const colvec &x)
+{
+  colvec zk(nOutputs_);
+  zk = zk.zeros();
+  return zk;
+}
+
+void CDEKF::dfdt(const colvec &x, const colvec &u, colvec &out)
+{
+  out = dfdt(x, u);
+}
+
+void CDEKF::h(const colvec &x, colvec &out)
+{
+  out = h(x);
+}
+
+void CDEKF::dfdt_batch(const mat &X, const colvec &u, mat &Y)
+{
+  Y.set_size(nStates_, X.n_cols);
+
+  // The columns of X and Y are passed to dfdt without copying them
+  for (uword k = 0; k < X.n_cols; k ++) {
+    const colvec x_k(const_cast<double*>(X.colptr(k)), X.n_rows, false, true);
+    colvec y_k(Y.colptr(k), Y.n_rows, false, true);
+    dfdt(x_k, u, y_k);
+  }
+}
+
+void CDEKF::h_batch(const mat &X, mat &Y)
+{
+  Y.set_size(nOutputs_, X.n_cols);
+
+  // The columns of X and Y are passed to h without copying them
+  for (uword k = 0; k < X.n_cols; k ++) {
+    const colvec x_k(const_cast<double*>(X.colptr(k)), X.n_rows, false, true);
+    colvec y_k(Y.colptr(k), Y.n_rows, false, true);
+    h(x_k, y_k);
+  }
+}
+
+void CDEKF::CalcA(const colvec &x, const colvec &u, const colvec &f0)
+{
+  // Column j holds x + epsilon * e_j, f(x) is already known
+  xEps_.set_size(nStates_, nStates_);
+  xEps_.each_col() = x;
+  xEps_.diag() += epsilon_;
+  dfdt_batch(xEps_, u, fEps_);
+
+  for (int j = 0; j < nStates_; j ++)
+    A_.col(j) = (fEps_.col(j) - f0) / epsilon_;
+}
+
+void CDEKF::CalcH(const colvec &x)
+{
+  // Column j holds x + epsilon * e_j, the last column holds x
+  xEps_.set_size(nStates_, nStates_ + 1);
+  xEps_.each_col() = x;
+  xEps_.diag() += epsilon_;
+  h_batch(xEps_, fEps_);
+
+  for (int j = 0; j < nStates_; j ++)
+    H_.col(j) = (fEps_.col(j) - fEps_.col(nStates_)) / epsilon_;
+}
+
+colvec CDEKF::Derivative(const colvec &y, const colvec &u)
+{
+  colvec x = y.head(nStates_);
+  colvec dx(nStates_);
+  dfdt(x, u, dx);
+
+  // Only the mean is integrated
+  if (y.n_elem == (uword)nStates_)
+    return dx;
+
+  // The covariance follows the linearization along the trajectory of the mean
+  CalcA(x, u, dx);
+  mat P(y.memptr() + nStates_, nStates_, nStates_);
+  mat dP = A_ * P + P * trans(A_) + Qc_;
+
+  return join_cols(dx, vectorise(dP));
+}
+
+void CDEKF::Integrate(colvec &y, const colvec &u, double t_span)
+{
+  // Dormand-Prince 5(4) coefficients, f does not depend on time so the nodes are not needed
+  static const double a21 = 1.0 / 5;
+  static const double a31 = 3.0 / 40, a32 = 9.0 / 40;
+  static const double a41 = 44.0 / 45, a42 = -56.0 / 15, a43 = 32.0 / 9;
+  static const double a51 = 19372.0 / 6561, a52 = -25360.0 / 2187, a53 = 64448.0 / 6561, a54 = -212.0 / 729;
+  static const double a61 = 9017.0 / 3168, a62 = -355.0 / 33, a63 = 46732.0 / 5247, a64 = 49.0 / 176, a65 = -5103.0 / 18656;
+  static const double b1 = 35.0 / 384, b3 = 500.0 / 1113, b4 = 125.0 / 192, b5 = -2187.0 / 6784, b6 = 11.0 / 84;
+  static const double e1 = 71.0 / 57600, e3 = -71.0 / 16695, e4 = 71.0 / 1920, e5 = -17253.0 / 339200, e6 = 22.0 / 525, e7 = -1.0 / 40;
+
+  // Avoid endless loops on a badly scaled problem
+  const double h_min = 1e-12 * t_span;
+
+  double t = 0;
+  double step = (h0_ < t_span) ? h0_ : t_span;
+  nSteps_ = 0;
+
+  // First same as last: k7 of an accepted step is k1 of the next one
+  colvec k1 = Derivative(y, u);
+
+  while (t < t_span) {
+    bool last = (t + step >= t_span);
+    double hk = last ? t_span - t : step;
+
+    colvec k2 = Derivative(y + hk * (a21 * k1), u);
+    colvec k3 = Derivative(y + hk * (a31 * k1 + a32 * k2), u);
+    colvec k4 = Derivative(y + hk * (a41 * k1 + a42 * k2 + a43 * k3), u);
+    colvec k5 = Derivative(y + hk * (a51 * k1 + a52 * k2 + a53 * k3 + a54 * k4), u);
+    colvec k6 = Derivative(y + hk * (a61 * k1 + a62 * k2 + a63 * k3 + a64 * k4 + a65 * k5), u);
+    colvec y_new = y + hk * (b1 * k1 + b3 * k3 + b4 * k4 + b5 * k5 + b6 * k6);
+    colvec k7 = Derivative(y_new, u);
+    nSteps_ ++;
+
+    // Local error, relative to the tolerances, root mean square over all elements
+    colvec err_vec = hk * (e1 * k1 + e3 * k3 + e4 * k4 + e5 * k5 + e6 * k6 + e7 * k7);
+    colvec scale = absTol_ + relTol_ * arma::max(abs(y), abs(y_new));
+    double err = sqrt(mean(square(err_vec / scale)));
+
+    if (err <= 1 || hk <= h_min) {
+      t = last ? t_span : t + hk;
+      y = y_new;
+      k1 = k7;
+      
+      // Remember the step size for the next time span, unless it was cut to fit the span
+      if (!last)
+        h0_ = hk;
+    }
+
+    // Grow or shrink the step, within safe limits
+    double factor = (err > 0) ? 0.9 * pow(err, -0.2) : 5;
+    factor = (factor < 0.2) ? 0.2 : ((factor > 5) ? 5 : factor);
+    step = hk * factor;
+    step = (step < h_min) ? h_min : step;
+  }
+}
+
+void CDEKF::InitSystemState(const colvec& x0)
+{
+  arma_assert_same_size(x_.n_rows, x_.n_cols, x0.n_rows, x0.n_cols, "Whoops, error initializing system states");
+  x_ = x0;
+  x_m_ = x0;
+}
+
+void CDEKF::InitSystemStateCovariance(const mat& P0)
+{
+  arma_assert_same_size(P0.n_rows, P0.n_cols, P_m_.n_rows, P_m_.n_cols, "Whoops, error initializing state covariance");
+  P_m_ = P0;
+}
+
+void CDEKF::SetTolerance(double rel_tol, double abs_tol)
+{
+  assert(rel_tol > 0 && abs_tol > 0 && "Whoops, tolerances must be positive");
+  relTol_ = rel_tol;
+  absTol_ = abs_tol;
+}
+
+void CDEKF::EKalmanf(const colvec& u)
+{
+  // Simulate true system, with noise
+  // Unit Gaussian noise from the generator of the filter
+  GetNoiseGenerator()->Gaussian(v_);
+  GetNoiseGenerator()->Gaussian(w_);
+  v_ = sqrt_Q_ * v_;
+  w_ = sqrt_R_ * w_;
+  Integrate(x_, u, dt_);
+  x_ = x_ + v_;
+  h(x_, z_);
+  z_ += w_;
+
+  EKalmanf(z_, u);
+}
+
+void CDEKF::EKalmanf(const colvec& z, const colvec& u)
+{
+  // Prior update, the mean and the covariance are integrated together:
+  colvec y = join_cols(x_m_, vectorise(P_m_));
+  Integrate(y, u, dt_);
+
+  x_p_ = y.head(nStates_);
+  P_p_ = reshape(y.tail(nStates_ * nStates_), nStates_, nStates_);
+  P_p_ = 0.5 * (P_p_ + trans(P_p_));
+
+  CalcH(x_p_);
+
+  // Measurement update, K = P_p * H' * S^-1 with S = H * P_p * H' + R,
+  // from the Cholesky factor of S
+  mat PHt = P_p_ * trans(H_);
+  S_ = H_ * PHt + R_;
+  factor_.Factor(S_);
+  factor_.Gain(PHt, K_);
+
+  h(x_p_, innov_);
+  innov_ = z - innov_;
+  factor_.Evaluate(innov_);
+  x_m_ = x_p_ + K_ * innov_;
+
+  // P_m = P_p - K * S * K'
+  P_m_ = P_p_;
+  factor_.Downdate(P_m_);
+
+  // Estimated output is the projection of etimated states to the output function
+  h(x_m_, z_m_);
+}
+
+colvec* CDEKF::GetCurrentState()
+{
+    return & x_;
+}
+
+colvec* CDEKF::GetCurrentOutput()
+{
+    return &z_;
+}
+
+colvec* CDEKF::GetCurrentEstimatedState()
+{
+    return &x_m_;
+}
+
+colvec* CDEKF::GetCurrentEstimatedOutput()
+{
+    return &z_m_;
+}
+
+int CDEKF::GetIntegrationSteps()
+{
+    return nSteps_;
+}
+
+double CDEKF::GetLogLikelihood()
+{
+    return factor_.GetLogLikelihood();
+}
+
+double CDEKF::GetNIS()
+{
+    return factor_.GetNIS();
+}
+
+void CDEKF::SetNoiseGenerator(NoiseGenerator* generator)
+{
+    noiseGenerator_ = generator;
+}
+
+NoiseGenerator* CDEKF::GetNoiseGenerator()
+{
+    return noiseGenerator_ ? noiseGenerator_ : &noise_;
+}
@@ -0,0 +1,305 @@
+/**
+ * @file cdekf.h
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Header file for the continuous-discrete extended Kalman filter implementation.
+ *
+ * @section DESCRIPTION
+ * Define a non-linear process with continuous-time dynamics and discrete-time measurements:
+ * \f[\dot{x} = f(x, u) + v\f]
+ * \f[z_k = h(x_k) + w_k\f]
+ * where:\n
+ * \f$f\f$ is the dynamic model of the system, as a time derivative\n
+ * \f$h\f$ is the measurement model of the system\n
+ * \f$v\f$ is the process noise (white, with spectral density Qc)\n
+ * \f$w\f$ is the measurement noise (Gaussian with covariance R)\n
+ * \f$x\f$ is the state vector\n
+ * \f$z\f$ is the output vector\n
+ * \f$u\f$ is the input vector, held constant between two measurements\n\n
+ * Between two measurements, the mean and the covariance are integrated together:
+ * \f[\dot{\hat{x}} = f(\hat{x}, u)\f]
+ * \f[\dot{P} = A P + P A^T + Q_c, \quad A = \frac{\partial f}{\partial x}(\hat{x}, u)\f]
+ * with an adaptive, error-controlled Dormand-Prince 5(4) integrator.
+ * The step size follows the dynamics, small steps are only taken where they are needed.
+ */
+
+#ifndef CDEKF_H
+#define CDEKF_H
+
+#define ARMA_USE_LAPACK // This definition must be before the include to the armadillo
+
+
+#define _USE_MATH_DEFINES
+
+#include <math.h>
+
+#include <assert.h>
+#include <armadillo>
+
+#include "innovation.h"
+#include "noise.h"
+
+using namespace std;
+using namespace arma;
+
+/*!
+ * @brief Implemetation of the continuous-discrete extended Kalman filter.
+ * This class needs to be derived.
+ */
+class CDEKF {
+public:
+  /*!
+   * \brief Constructor, nothing happens here.
+   */
+  CDEKF();
+
+  /*!
+   * \brief Destructur, nothing happens here.
+   */
+  ~CDEKF();
+
+  /*!
+   * \brief Tell me how many states and outputs you have!
+   * @param n_states Number of the elements on the input vector x
+   * @param n_outputs Number of the elements on the otput vector z
+   * @param Qc Process noise spectral density
+   * @param R Measurement noise covariance
+   * @param dt Time between two measurements
+   */
+  void InitSystem(int n_states, int n_outputs, const mat& Qc, const mat& R, double dt);
+
+  /*!
+   * \brief Define the dynamic model of your system, as a time derivative.
+   * @param x System states
+   * @param u System inputs
+   * @return dx/dt
+   */
+  virtual colvec dfdt(const colvec &x, const colvec &u);
+
+  /*!
+   * \brief Define the output model of your system.
+   * @param x System states
+   */
+  virtual colvec h(const colvec &x);
+
+  /*!
+   * \brief Define the dynamic model of your system, writing the result in place.
+   * Override this one instead of dfdt(x, u) and no vector is returned by value:
+   * the filter always evaluates dfdt through it. The default calls dfdt(x, u).
+   * out is never x, and already has its size, out.set_size with that same
+   * size is allowed.
+   * @param x System states
+   * @param u System inputs
+   * @param out dx/dt, this is a returned value
+   */
+  virtual void dfdt(const colvec &x, const colvec &u, colvec &out);
+
+  /*!
+   * \brief Define the output model of your system, writing the result in place.
+   * Same as dfdt(x, u, out), the default calls h(x).
+   * @param x System states
+   * @param out h(x), this is a returned value
+   */
+  virtual void h(const colvec &x, colvec &out);
+
+  /*!
+   * \brief Evaluate dfdt at several states in one call.
+   * The perturbed states of the Jacobian are evaluated through this function.
+   * Override it to vectorize the model over the columns. The default calls
+   * dfdt for each column.
+   * @param X System states, one per column
+   * @param u System inputs
+   * @param Y dx/dt at each column of X, this is a returned value
+   */
+  virtual void dfdt_batch(const mat &X, const colvec &u, mat &Y);
+
+  /*!
+   * \brief Evaluate h at several states in one call, see dfdt_batch.
+   * @param X System states, one per column
+   * @param Y h of each column of X, this is a returned value
+   */
+  virtual void h_batch(const mat &X, mat &Y);
+
+  /*!
+   * \brief Initialize the system states.
+   * Must be called after InitSystem.
+   * If not called, system state is initialized to zero.
+   * @param x0 Inital value for the system state
+   */
+  void InitSystemState(const colvec& x0);
+
+  /*!
+   * \brief Initialize the system state covariance.
+   * Must be called after InitSystem.
+   * If not called, state covariance is initialized to an identity matrix.
+   * @param P0 Inital value for the state covariance
+   */
+  void InitSystemStateCovariance(const mat& P0);
+
+  /*!
+   * \brief Set the error tolerances of the integrator.
+   * The local error of every integrated element y must stay below abs_tol + rel_tol * |y|.
+   * If not called, rel_tol = 1e-6 and abs_tol = 1e-9.
+   * @param rel_tol Relative tolerance
+   * @param abs_tol Absolute tolerance
+   */
+  void SetTolerance(double rel_tol, double abs_tol);
+
+  /*!
+   * \brief Do the extended Kalman iteration step-by-step while simulating the system.
+   * Simulating the system is done to calculate system states and outputs.
+   * @param u The applied input to the system
+   */
+  void EKalmanf(const colvec& u);
+
+  /*!
+   * \brief Do the extended Kalman iteration step-by-step without simulating the system.
+   * Use this if measurement is available and simulating the system is unnecessary.
+   * Here, true system states and system outputs do not matter.
+   * The only thing that matters is the estimated states.
+   * @param z The measurement outputs, this is a returned value
+   * @param u The applied input to the system
+   */
+  void EKalmanf(const colvec& z, const colvec& u);
+
+ /*!
+  * @brief Get current simulated true state.
+  * @return Current simulated state of the system \f$x_k\f$
+  */
+  colvec* GetCurrentState();
+
+ /*!
+  * @brief Get current simulated true output.
+  * This is analogous to the measurements.
+  * @return Current simulated output \f$z_k\f$
+  */
+  colvec* GetCurrentOutput();
+
+ /*!
+  * @brief Get current estimated state.
+  * This is analogous to the filtered measurements.
+  * @return Current estimated state \f$\hat{x}_k\f$
+  */
+  colvec* GetCurrentEstimatedState();
+
+ /*!
+  * @brief Get current estimated output.
+  * @return Current estimated output \f$\hat{z}_k\f$
+  */
+  colvec* GetCurrentEstimatedOutput();
+
+ /*!
+  * @brief Number of integration steps taken by the last prior update.
+  * @return Accepted steps plus rejected steps
+  */
+  int GetIntegrationSteps();
+
+ /*!
+  * @brief Get the log-likelihood of the last measurement.
+  * The density of the innovation under N(0, S), S being the innovation
+  * covariance, for model selection or multiple model filters.
+  * @return Log-likelihood of the last measurement
+  */
+  double GetLogLikelihood();
+
+ /*!
+  * @brief Get the normalized innovation squared of the last measurement.
+  * Chi-square distributed with n_outputs degrees of freedom when the filter is consistent.
+  * @return innov' S^-1 innov
+  */
+  double GetNIS();
+
+  /*!
+   * @brief Use another generator for the noise of the simulated system.
+   * The filter does not own it, it must live as long as the filter simulates with it.
+   * @param generator Noise generator, 0 to go back to the own one of the filter
+   */
+  void SetNoiseGenerator(NoiseGenerator* generator);
+
+  /*!
+   * @brief Get the generator of the noise of the simulated system, to seed it.
+   * @return The generator in use
+   */
+  NoiseGenerator* GetNoiseGenerator();
+
+private:
+  /*!
+   * \brief Time derivative of the integrated vector.
+   * The vector holds the mean, followed by the covariance (column by column) if
+   * it is also integrated. The Jacobian of f is computed at the same point.
+   * @param y Integrated vector
+   * @param u Input vector
+   * @return dy/dt
+   */
+  colvec Derivative(const colvec &y, const colvec &u);
+
+  /*!
+   * \brief Integrate y over a time span with the adaptive Dormand-Prince 5(4) method.
+   * @param y Integrated vector, this is a returned value
+   * @param u Input vector
+   * @param t_span Length of the time span
+   */
+  void Integrate(colvec &y, const colvec &u, double t_span);
+
+  /*!
+   * \brief Compute the Jacobian of f numerically using  a  small
+   * finite-difference perturbation magnitude.
+   * @param x System states
+   * @param u Input vector
+   * @param f0 The value of f at x, already known by the caller
+   */
+  void CalcA(const colvec &x, const colvec &u, const colvec &f0);
+
+  /*!
+   * \brief Compute the Jacobian of h numerically using  a  small
+   * finite-difference perturbation magnitude.
+   * @param x System states
+   */
+  void CalcH(const colvec &x);
+
+  mat A_;          ///< Jacobian of f
+  mat xEps_;       ///< Perturbed states, one per column
+  mat fEps_;       ///< Perturbed model evaluations, one per column
+  mat H_;          ///< Jacobian of h
+  mat Qc_;         ///< Process noise spectral density
+  mat R_;          ///< Measurement noise covariance
+  colvec v_;       ///< Gaussian process noise
+  colvec w_;       ///< Gaussian measurement noise
+
+  mat sqrt_Q_;     ///< Lower Cholesky factor of Q, over one sample time, the process noise is sqrt_Q_ v_
+  mat sqrt_R_;     ///< Lower Cholesky factor of R, the measurement noise is sqrt_R_ w_
+
+  NoiseGenerator noise_;            ///< Own generator of the noise
+  NoiseGenerator* noiseGenerator_;  ///< Generator in use, 0 for noise_
+
+  colvec x_m_;     ///< State vector after measurement update
+  colvec x_p_;     ///< State vector after a priori update
+
+  mat P_p_;        ///< State covariance after a priori update
+  mat P_m_;        ///< State covariance after measurement update
+
+  colvec z_m_;     ///< Estimated output
+
+  mat S_;          ///< Innovation covariance
+  InnovationFactor<double> factor_; ///< Cholesky factor of S_
+  mat K_;          ///< Kalman gain
+  colvec innov_;   ///< Innovation
+
+  double epsilon_; ///< Very small number
+  double dt_;      ///< Time between two measurements
+  double relTol_;  ///< Relative tolerance of the integrator
+  double absTol_;  ///< Absolute tolerance of the integrator
+  double h0_;      ///< Last accepted integration step, starting guess of the next span
+  int nSteps_;     ///< Integration steps of the last prior update
+
+protected:
+
+  int nStates_;   ///< Number of the states
+  int nOutputs_;  ///< Number of outputs
+
+  colvec x_;      ///< State vector
+  colvec z_;      ///< Output matrix
+};
+
+
+#endif
@@ -7,37 +7,57 @@
 
 #include "ekf.h"
 
-EKF::EKF()
+template <class eT>
+BasicEKF<eT>::BasicEKF()
 {
-
+  modelThreadSafe_ = false;
+  
+  lazyJacobian_ = false;
+  relinearize_ = true;
+  stateThreshold_ = 0;
+  maxSteps_ = 0;
+  nisThreshold_ = 0;
+  stepsF_ = 0;
+  
+  fTable_ = 0;
+  
+  logLik_ = 0;
+  nis_ = 0;
+  
+  noiseGenerator_ = 0;
 }
 
-EKF::~EKF()
+template <class eT>
+BasicEKF<eT>::~BasicEKF()
 {
 
 }
 
-void EKF::InitSystem(int n_states, int n_outputs, const mat& Q, const mat& R)
+template <class eT>
+void BasicEKF<eT>::InitSystem(int n_states, int n_outputs, const mat& Q, const mat& R)
 {
   assert(Q.is_square() && "Whoops, Q must be a square matrix");
   assert(R.is_square() && "Whoops, R must be a square matrix (n_outputs x n_outputs)");
   
-  // Epsilon for computing the Jacobian numerically
-  epsilon_= 1e-8;
+  // Epsilon for computing the Jacobian numerically, single precision only
+  // has about 7 digits, so the step must stay well above its rounding
+  epsilon_= (sizeof(eT) == sizeof(float)) ? 1e-3 : 1e-8;
   
   nStates_ = n_states;
   nOutputs_ = n_outputs;
   
   Q_ = Q;
-  R_ = R;
   
-  // Stdev is sqrt of variance
-  sqrt_Q_ = sqrt(Q_);
-  sqrt_R_ = sqrt(R_);
+  // Cholesky factors of the noise covariances, the simulation draws unit noise through them
+  NoiseGenerator::CovarianceFactor(Q_, sqrt_Q_);
+  NoiseGenerator::CovarianceFactor(R, sqrt_R_);
 
   x_.resize(n_states);
   F_.resize(n_states, n_states);
-  H_.resize(n_outputs, n_states);
+  
+  // The measurement model given here is sensor 0
+  sensors_.clear();
+  AddSensor(n_outputs, R);
   
   x_p_.resize(n_states);
   x_m_.resize(n_states);
@@ -55,140 +75,461 @@ void EKF::InitSystem(int n_states, int n_outputs, const mat& Q, const mat& R)
   // Inital values for the Kalman iterations
   P_m_ = P_m_.eye();
   x_m_ = x_m_.zeros();
+  
+  // Workspace, the steps only write into these
+  xEps_.set_size(n_states, n_states + 1);
+  fEps_.set_size(n_states, n_states + 1);
+  Ft_.set_size(n_states, n_states);
+  FP_.set_size(n_states, n_states);
+  dx_.set_size(n_states);
+  xw_.set_size(n_states);
+  z_.set_size(n_outputs);
+  z_m_.set_size(n_outputs);
+  Wdx_.set_size(n_states);
+  
+  // Force the first linearization
+  relinearize_ = true;
 }
 
-colvec EKF::f(const colvec &x, const colvec &u)
+template <class eT>
+typename BasicEKF<eT>::colvec BasicEKF<eT>::f(const colvec &x, const colvec &u)
 {
   colvec xk(nOutputs_);
   xk = xk.zeros();
   return xk;
 }
 
-colvec EKF::h(const colvec &x)
+template <class eT>
+typename BasicEKF<eT>::colvec BasicEKF<eT>::h(const colvec &x)
 {
   colvec zk(nOutputs_);
   zk = zk.zeros();
   return zk;
 }
 
-void EKF::CalcF(const colvec &x, const colvec &u)
+template <class eT>
+typename BasicEKF<eT>::colvec BasicEKF<eT>::h(const colvec &x, int sensor)
+{
+  assert(sensor == 0 && "Whoops, h(x, sensor) must be defined for the additional sensors");
+  return h(x);
+}
+
+template <class eT>
+void BasicEKF<eT>::f(const colvec &x, const colvec &u, colvec &out)
+{
+  out = f(x, u);
+}
+
+template <class eT>
+void BasicEKF<eT>::h(const colvec &x, colvec &out)
+{
+  out = h(x);
+}
+
+template <class eT>
+void BasicEKF<eT>::h(const colvec &x, int sensor, colvec &out)
+{
+  if (sensor == 0)
+    h(x, out);
+  else
+    out = h(x, sensor);
+}
+
+template <class eT>
+void BasicEKF<eT>::f_batch(const mat &X, const colvec &u, mat &Y)
+{
+  Y.set_size(nStates_, X.n_cols);
+  
+  // The columns of X and Y are passed to f without copying them
+  if (modelThreadSafe_ && pool_.GetNumberOfThreads() > 1) {
+    pool_.ParallelFor(X.n_cols, [&](int k, int t) {
+      const colvec x_k(const_cast<eT*>(X.colptr(k)), X.n_rows, false, true);
+      colvec y_k(Y.colptr(k), Y.n_rows, false, true);
+      f(x_k, u, y_k);
+    });
+    return;
+  }
+  
+  for (uword k = 0; k < X.n_cols; k ++) {
+    const colvec x_k(const_cast<eT*>(X.colptr(k)), X.n_rows, false, true);
+    colvec y_k(Y.colptr(k), Y.n_rows, false, true);
+    f(x_k, u, y_k);
+  }
+}
+
+template <class eT>
+void BasicEKF<eT>::h_batch(const mat &X, mat &Y)
+{
+  HBatch(X, Y, 0);
+}
+
+template <class eT>
+void BasicEKF<eT>::h_batch(const mat &X, mat &Y, int sensor)
+{
+  if (sensor == 0)
+    h_batch(X, Y);
+  else
+    HBatch(X, Y, sensor);
+}
+
+template <class eT>
+void BasicEKF<eT>::HBatch(const mat &X, mat &Y, int sensor)
 {
-  colvec f0 = f(x, u);
+  Y.set_size(sensors_[sensor].nOutputs, X.n_cols);
   
-  colvec fn;
+  // The columns of X and Y are passed to h without copying them
+  if (modelThreadSafe_ && pool_.GetNumberOfThreads() > 1) {
+    pool_.ParallelFor(X.n_cols, [&](int k, int t) {
+      const colvec x_k(const_cast<eT*>(X.colptr(k)), X.n_rows, false, true);
+      colvec y_k(Y.colptr(k), Y.n_rows, false, true);
+      h(x_k, sensor, y_k);
+    });
+    return;
+  }
   
-  for (int j = 0; j < nStates_; j ++) {
-    colvec x_eps = x;
-    x_eps(j) = x_eps(j) + epsilon_;
-    fn = f(x_eps, u);
-    
-    for (int i = 0; i < nStates_; i ++) {
-      F_(i, j) = (fn(i) - f0(i)) / epsilon_;     
-    }
+  for (uword k = 0; k < X.n_cols; k ++) {
+    const colvec x_k(const_cast<eT*>(X.colptr(k)), X.n_rows, false, true);
+    colvec y_k(Y.colptr(k), Y.n_rows, false, true);
+    h(x_k, sensor, y_k);
   }
+}
+
+template <class eT>
+void BasicEKF<eT>::PerturbedStates(const colvec &x)
+{
+  // Column j holds x + epsilon * e_j, the last column holds x
+  xEps_.set_size(nStates_, nStates_ + 1);
+  xEps_.each_col() = x;
+  xEps_.diag() += epsilon_;
+}
+
+template <class eT>
+void BasicEKF<eT>::CalcF(const colvec &x, const colvec &u)
+{
+  PerturbedStates(x);
+  f_batch(xEps_, u, fEps_);
+  
+  for (int j = 0; j < nStates_; j ++)
+    F_.col(j) = (fEps_.col(j) - fEps_.col(nStates_)) / epsilon_;
   
   //F_.print();
 }
 
-void EKF::CalcH(const colvec &x)
+template <class eT>
+void BasicEKF<eT>::CalcH(const colvec &x, int sensor)
+{
+  mat &H = sensors_[sensor].H;
+  
+  mat &hEps = sensors_[sensor].hEps;
+  
+  PerturbedStates(x);
+  h_batch(xEps_, hEps, sensor);
+  
+  for (int j = 0; j < nStates_; j ++)
+    H.col(j) = (hEps.col(j) - hEps.col(nStates_)) / epsilon_;
+  
+  //H.print();
+}
+
+template <class eT>
+void BasicEKF<eT>::SetModelThreadSafe(bool thread_safe)
+{
+  modelThreadSafe_ = thread_safe;
+}
+
+template <class eT>
+void BasicEKF<eT>::SetJacobianThreads(int n_threads)
+{
+  assert(n_threads > 0 && "Whoops, at least one thread is needed");
+  
+  pool_.Start(n_threads);
+}
+
+template <class eT>
+void BasicEKF<eT>::SetRelinearizationPolicy(double state_threshold, int max_steps, double nis_threshold)
+{
+  lazyJacobian_ = true;
+  stateThreshold_ = state_threshold;
+  maxSteps_ = max_steps;
+  nisThreshold_ = nis_threshold;
+  ForceRelinearization();
+}
+
+template <class eT>
+void BasicEKF<eT>::SetRelinearizationNorm(const mat& W)
 {
-  colvec h0 = h(x);
+  arma_assert_same_size(W.n_rows, W.n_cols, F_.n_rows, F_.n_cols, "Whoops, W must be n_states x n_states");
+  W_ = W;
+}
+
+template <class eT>
+void BasicEKF<eT>::TabulateF(JacobianTable& table, const colvec& x_nominal, const colvec& u)
+{
+  assert(table.Fits(nStates_, nStates_) && "Whoops, the table must be n_states x n_states");
+  
+  for (int k = 0; k < table.GetNumberOfNodes(); k ++) {
+    CalcF(table.GetNode(k, x_nominal), u);
+    table.SetNode(k, F_);
+  }
   
-  colvec hn;
+  // F_ no longer belongs to the current operating point
+  relinearize_ = true;
+}
+
+template <class eT>
+void BasicEKF<eT>::TabulateH(JacobianTable& table, const colvec& x_nominal, int sensor)
+{
+  assert(table.Fits(sensors_[sensor].nOutputs, nStates_) && "Whoops, the table must be n_outputs x n_states");
   
-  for (int j = 0; j < nStates_; j ++) {
-    colvec x_eps = x;
-    x_eps(j) = x_eps(j) + epsilon_;
-    hn = h(x_eps);
-   
-    for (int i = 0; i < nOutputs_; i ++) 
-      H_(i, j) = (hn(i) - h0(i)) / epsilon_;    
+  for (int k = 0; k < table.GetNumberOfNodes(); k ++) {
+    CalcH(table.GetNode(k, x_nominal), sensor);
+    table.SetNode(k, sensors_[sensor].H);
   }
   
-  //H_.print();
+  // H no longer belongs to the current operating point
+  sensors_[sensor].relinearize = true;
+}
+
+template <class eT>
+bool BasicEKF<eT>::UseJacobianTables(const JacobianTable* F_table, const JacobianTable* H_table)
+{
+  bool fits = (!F_table || F_table->Fits(nStates_, nStates_)) &&
+      (!H_table || H_table->Fits(sensors_[0].nOutputs, nStates_));
+  
+  fTable_ = fits ? F_table : 0;
+  sensors_[0].table = fits ? H_table : 0;
+  ForceRelinearization();
+  return fits;
+}
+
+template <class eT>
+bool BasicEKF<eT>::UseSensorJacobianTable(const JacobianTable* H_table, int sensor)
+{
+  assert(sensor >= 0 && sensor < (int)sensors_.size() && "Whoops, unknown sensor");
+  
+  bool fits = !H_table || H_table->Fits(sensors_[sensor].nOutputs, nStates_);
+  
+  sensors_[sensor].table = fits ? H_table : 0;
+  sensors_[sensor].relinearize = true;
+  return fits;
+}
+
+template <class eT>
+int BasicEKF<eT>::AddSensor(int n_outputs, const mat& R)
+{
+  assert(R.is_square() && R.n_rows == (uword)n_outputs && "Whoops, R must be a square matrix (n_outputs x n_outputs)");
+  
+  Sensor sensor;
+  sensor.nOutputs = n_outputs;
+  sensor.R = R;
+  sensor.H.zeros(n_outputs, nStates_);
+  sensor.steps = 0;
+  sensor.relinearize = true;
+  sensor.table = 0;
+  
+  // Workspace of the update
+  sensor.hEps.set_size(n_outputs, nStates_ + 1);
+  sensor.Ht.set_size(nStates_, n_outputs);
+  sensor.PHt.set_size(nStates_, n_outputs);
+  sensor.S.set_size(n_outputs, n_outputs);
+  sensor.factor.SetSize(nStates_, n_outputs);
+  sensor.K.set_size(nStates_, n_outputs);
+  sensor.innov.set_size(n_outputs);
+  
+  sensors_.push_back(sensor);
+  return (int)sensors_.size() - 1;
+}
+
+template <class eT>
+void BasicEKF<eT>::ForceRelinearization()
+{
+  relinearize_ = true;
+  for (size_t k = 0; k < sensors_.size(); k ++)
+    sensors_[k].relinearize = true;
+}
+
+template <class eT>
+bool BasicEKF<eT>::IsLinearizationStale(const colvec& x, const colvec& x_lin, int steps, bool relinearize)
+{
+  if (!lazyJacobian_ || relinearize)
+    return true;
+  
+  if (maxSteps_ > 0 && steps >= maxSteps_)
+    return true;
+  
+  dx_ = x;
+  dx_ -= x_lin;
+  if (W_.is_empty())
+    return norm(dx_) > stateThreshold_;
+  
+  Wdx_ = W_ * dx_;
+  return sqrt(dot(dx_, Wdx_)) > stateThreshold_;
 }
 
-void EKF::InitSystemState(const colvec& x0)
+template <class eT>
+void BasicEKF<eT>::InitSystemState(const colvec& x0)
 {
   arma_assert_same_size(x_.n_rows, x_.n_cols, x0.n_rows, x0.n_cols, "Whoops, error initializing system states");
   x_ = x0;
   x_m_ = x0;
 }
 
-void EKF::InitSystemStateCovariance(const mat& P0)
+template <class eT>
+void BasicEKF<eT>::InitSystemStateCovariance(const mat& P0)
 {
   arma_assert_same_size(P0.n_rows, P0.n_cols, P_m_.n_rows, P_m_.n_cols, "Whoops, error initializing state covariance");
   P_m_ = P0;
 }
 
 
-void EKF::EKalmanf(const colvec& u)
+template <class eT>
+void BasicEKF<eT>::EKalmanf(const colvec& u)
 {  
   // Simulate true system, with noise
-  // randn uses a normal/Gaussian distribution with zero mean and unit variance
-  v_.randn(F_.n_rows);
-  w_.randn(H_.n_rows);
-  v_ = sqrt_Q_ * v_;
-  w_ = sqrt_R_ * w_;
-  x_ = f(x_, u) + v_;
-  z_ = h(x_) + w_;
-  
-  CalcF(x_m_, u);
-    
-  // Prior update:
-  x_p_ = f(x_m_, u);
-  P_p_ = F_ * P_m_ * trans(F_) + Q_;
-  
-  CalcH(x_p_);
-  
-  // Measurement update:
-  mat K = P_p_ * trans(H_) * inv(H_ * P_p_ * trans(H_) + R_);
-  x_m_ = x_p_ + K * (z_ - h(x_p_));
-  P_m_ = P_p_ - K * H_ * P_p_;
+  // Unit Gaussian noise from the generator of the filter
+  GetNoiseGenerator()->Gaussian(v_);
+  GetNoiseGenerator()->Gaussian(w_);
+  f(x_, u, xw_);
+  x_ = xw_;
+  x_ += sqrt_Q_ * v_;
+  h(x_, z_);
+  z_ += sqrt_R_ * w_;
   
-  // Estimated output is the projection of etimated states to the output function
-  z_m_ = h(x_m_);
+  EKalmanf(z_, u);
 }
 
-void EKF::EKalmanf(const colvec& z, const colvec& u)
+template <class eT>
+void BasicEKF<eT>::EKalmanf(const colvec& z, const colvec& u)
 {    
-  CalcF(x_m_, u);
+  Predict(u);
+  Update(z, 0);
+}
+
+template <class eT>
+void BasicEKF<eT>::Predict(const colvec& u)
+{
+  if (fTable_)
+    fTable_->Lookup(x_m_, F_);
+  else if (IsLinearizationStale(x_m_, xLinF_, stepsF_, relinearize_)) {
+    CalcF(x_m_, u);
+    xLinF_ = x_m_;
+    stepsF_ = 0;
+    relinearize_ = false;
+  }
+  stepsF_ ++;
+  
+  // Prior update, P_p = F * P_m * F' + Q
+  f(x_m_, u, x_p_);
+  Ft_ = trans(F_);
+  SmallMat::Sandwich(F_, P_m_, Ft_, FP_, P_p_);
+  P_p_ += Q_;
+  
+  // Until a measurement arrives, the prior is the best estimate
+  x_m_ = x_p_;
+  P_m_ = P_p_;
+}
+
+template <class eT>
+void BasicEKF<eT>::Update(const colvec& z, int sensor)
+{
+  assert(sensor >= 0 && sensor < (int)sensors_.size() && "Whoops, unknown sensor");
+  
+  // Only the Jacobian of the sensor that produced z is needed
+  Sensor &s = sensors_[sensor];
+  if (s.table)
+    s.table->Lookup(x_m_, s.H);
+  else if (IsLinearizationStale(x_m_, s.xLin, s.steps, s.relinearize)) {
+    CalcH(x_m_, sensor);
+    s.xLin = x_m_;
+    s.steps = 0;
+    s.relinearize = false;
+  }
+  s.steps ++;
   
-  // Prior update:
-  x_p_ = f(x_m_, u);
-  P_p_ = F_ * P_m_ * trans(F_) + Q_;
+  // Measurement update, K = P * H' * S^-1 with S = H * P * H' + R,
+  // from the Cholesky factor of S
+  h(x_m_, sensor, s.innov);
+  s.innov *= -1;
+  s.innov += z;
+  s.Ht = trans(s.H);
+  SmallMat::Multiply(P_m_, s.Ht, s.PHt);
+  SmallMat::Multiply(s.H, s.PHt, s.S);
+  s.S += s.R;
+  s.factor.Factor(s.S);
+  s.factor.Gain(s.PHt, s.K);
+  x_m_ += s.K * s.innov;
   
-  CalcH(x_p_);
+  // P = P - K * S * K'
+  s.factor.Downdate(P_m_);
   
-  // Measurement update:
-  mat K = P_p_ * trans(H_) * inv(H_ * P_p_ * trans(H_) + R_);
-  x_m_ = x_p_ + K * (z - h(x_p_));
-  P_m_ = P_p_ - K * H_ * P_p_;
+  nis_ = s.factor.Evaluate(s.innov);
+  logLik_ = s.factor.GetLogLikelihood();
+  
+  // A large normalized innovation means the Jacobians no longer describe the model well
+  if (lazyJacobian_ && nisThreshold_ > 0 && nis_ > nisThreshold_)
+    ForceRelinearization();
 
   // Estimated output is the projection of etimated states to the output function
-  z_m_ = h(x_m_);
+  z_m_.set_size(s.nOutputs);
+  h(x_m_, sensor, z_m_);
 }
 
-colvec* EKF::GetCurrentState()
+template <class eT>
+typename BasicEKF<eT>::colvec* BasicEKF<eT>::GetCurrentState()
 {
     return & x_;
 }
 
-colvec* EKF::GetCurrentOutput()
+template <class eT>
+typename BasicEKF<eT>::colvec* BasicEKF<eT>::GetCurrentOutput()
 {
     return &z_;
 }
 
-colvec* EKF::GetCurrentEstimatedState()
+template <class eT>
+typename BasicEKF<eT>::colvec* BasicEKF<eT>::GetCurrentEstimatedState()
 {
     return &x_m_;
 }
 
 
-colvec* EKF::GetCurrentEstimatedOutput()
+template <class eT>
+typename BasicEKF<eT>::colvec* BasicEKF<eT>::GetCurrentEstimatedOutput()
 {
     return &z_m_;
 }
 
+template <class eT>
+double BasicEKF<eT>::GetLogLikelihood()
+{
+  return logLik_;
+}
+
+template <class eT>
+double BasicEKF<eT>::GetNIS()
+{
+  return nis_;
+}
+
+template <class eT>
+ThreadPool* BasicEKF<eT>::ModelPool()
+{
+  if (modelThreadSafe_ && pool_.GetNumberOfThreads() > 1)
+    return &pool_;
+  return 0;
+}
 
+template <class eT>
+void BasicEKF<eT>::SetNoiseGenerator(NoiseGenerator* generator)
+{
+  noiseGenerator_ = generator;
+}
+
+template <class eT>
+NoiseGenerator* BasicEKF<eT>::GetNoiseGenerator()
+{
+  return noiseGenerator_ ? noiseGenerator_ : &noise_;
+}
 
+template class BasicEKF<float>;
+template class BasicEKF<double>;
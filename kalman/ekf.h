@@ -30,6 +30,14 @@
 
 #include <assert.h>
 #include <armadillo>
+#include <vector>
+
+#include "innovation.h"
+#include "smallmat.h"
+#include "noise.h"
+#include "jtable.h"
+#include "threadpool.h"
+#include "model_call.h"
 
 using namespace std;
 using namespace arma;
@@ -37,18 +45,24 @@ using namespace arma;
 /*!
  * @brief Implemetation of the extended Kalman filter. 
  * This class needs to be derived.
+ * The element type eT is float or double, see EKF and fEKF. Inside the
+ * filter and its derived classes, mat and colvec are of that type.
  */
-class EKF {
-public:  
+template <class eT>
+class BasicEKF {
+public:
+  typedef Mat<eT> mat;      ///< Matrix of the element type
+  typedef Col<eT> colvec;   ///< Column vector of the element type
+
   /*!
    * \brief Constructor, nothing happens here.
    */
-  EKF();
+  BasicEKF();
   
   /*!
    * \brief Destructur, nothing happens here.
    */
-  ~EKF();
+  ~BasicEKF();
   
   /*!
    * \brief Tell me how many states and outputs you have!
@@ -70,6 +84,86 @@ public:
    * @param x System states
    */
   virtual colvec h(const colvec &x);
+  
+  /*!
+   * \brief Define the output model of an additional sensor, see AddSensor.
+   * The default calls h(x) for sensor 0. It must be overridden when
+   * additional sensors are registered.
+   * @param x System states
+   * @param sensor Index of the sensor
+   */
+  virtual colvec h(const colvec &x, int sensor);
+  
+  /*!
+   * \brief Define model of your system, writing the result in place.
+   * Override this one instead of f(x, u) and no vector is returned by value:
+   * the filter always evaluates f through it. The default calls f(x, u).
+   * out is never x, and already has its size, out.set_size with that same
+   * size is allowed.
+   * @param x System states
+   * @param u System inputs
+   * @param out f(x, u), this is a returned value
+   */
+  virtual void f(const colvec &x, const colvec &u, colvec &out);
+  
+  /*!
+   * \brief Define the output model of your system, writing the result in place.
+   * Same as f(x, u, out), the default calls h(x).
+   * @param x System states
+   * @param out h(x), this is a returned value
+   */
+  virtual void h(const colvec &x, colvec &out);
+  
+  /*!
+   * \brief Define the output model of a sensor, writing the result in place.
+   * Same as f(x, u, out). The default calls h(x, out) for sensor 0 and
+   * h(x, sensor) for the additional sensors.
+   * @param x System states
+   * @param sensor Index of the sensor
+   * @param out h(x) of the sensor, this is a returned value
+   */
+  virtual void h(const colvec &x, int sensor, colvec &out);
+  
+  /*!
+   * \brief Evaluate f at several states in one call.
+   * The filter evaluates its multi-point sets (the perturbed states of the
+   * Jacobian) through this function. Override it to vectorize the model over
+   * the columns. The default calls f for each column, on the thread pool if
+   * SetModelThreadSafe(true) and SetJacobianThreads were called.
+   * @param X System states, one per column
+   * @param u System inputs
+   * @param Y f of each column of X, this is a returned value
+   */
+  virtual void f_batch(const mat &X, const colvec &u, mat &Y);
+  
+  /*!
+   * \brief Evaluate h at several states in one call, see f_batch.
+   * The default calls h(x, 0) for each column.
+   * @param X System states, one per column
+   * @param Y h of each column of X, this is a returned value
+   */
+  virtual void h_batch(const mat &X, mat &Y);
+  
+  /*!
+   * \brief Evaluate the output model of a sensor at several states in one call, see f_batch.
+   * The default calls h_batch(X, Y) for sensor 0 and h(x, sensor) for each
+   * column for the other sensors.
+   * @param X System states, one per column
+   * @param Y h of each column of X, this is a returned value
+   * @param sensor Index of the sensor
+   */
+  virtual void h_batch(const mat &X, mat &Y, int sensor);
+  
+  /*!
+   * \brief Register an additional sensor with its own measurement model.
+   * The measurement model given to InitSystem is sensor 0.
+   * Must be called after InitSystem.
+   * @param n_outputs Number of the elements on the output vector of this sensor
+   * @param R Measurement noise covariance of this sensor
+   * @return Index of the new sensor
+   */
+  int AddSensor(int n_outputs, const mat& R);
+  
   /*!
    * \brief Initialize the system states.
    * Must be called after InitSystem.
@@ -85,6 +179,82 @@ public:
    * @param P0 Inital value for the state covariance
    */
   void InitSystemStateCovariance(const mat& P0);
+  
+  /*!
+   * \brief Declare that f and h are reentrant and can be called concurrently.
+   * This is a contract from the user: f and h must not modify shared data.
+   * Without it, the Jacobians are always computed sequentially.
+   * @param thread_safe True if f and h can be called from several threads
+   */
+  void SetModelThreadSafe(bool thread_safe);
+  
+  /*!
+   * \brief Compute the columns of the Jacobians of f and h in parallel.
+   * The perturbed models are evaluated on a persistent thread pool, by the
+   * default f_batch and h_batch.
+   * This only pays off when f or h are expensive, and it only takes effect
+   * after SetModelThreadSafe(true).
+   * @param n_threads Number of threads, including the calling thread, 1 disables it
+   */
+  void SetJacobianThreads(int n_threads);
+  
+  /*!
+   * \brief Reuse the Jacobians F and H while the operating point barely moves.
+   * By default, both Jacobians are recomputed at every step. After calling this
+   * function, a Jacobian is only recomputed when one of these is true:\n
+   * - the state moved more than state_threshold since the Jacobian was computed\n
+   * - the Jacobian has been used for max_steps steps\n
+   * - the normalized innovation squared of the last update exceeded nis_threshold\n
+   * @param state_threshold Distance of the state, see SetRelinearizationNorm
+   * @param max_steps Maximum age of a Jacobian in steps, 0 for no limit
+   * @param nis_threshold Limit of the normalized innovation squared, 0 to disable it
+   */
+  void SetRelinearizationPolicy(double state_threshold, int max_steps, double nis_threshold);
+  
+  /*!
+   * \brief Define the norm used to measure how far the state moved, \f$\sqrt{dx^T W dx}\f$.
+   * Must be called after InitSystem. If not called, the Euclidean norm is used.
+   * @param W Symmetric positive definite weighting matrix (n_states x n_states)
+   */
+  void SetRelinearizationNorm(const mat& W);
+  
+  /*!
+   * \brief Fill a Jacobian table of f, using the same finite differences as the filter.
+   * Must be called after InitSystem. The table must have been initialized with
+   * JacobianTable::InitGrid, with n_states rows and n_states columns.
+   * @param table The table to fill
+   * @param x_nominal Nominal state, gives the non-scheduling components
+   * @param u Input vector used while tabulating
+   */
+  void TabulateF(JacobianTable& table, const colvec& x_nominal, const colvec& u);
+  
+  /*!
+   * \brief Fill a Jacobian table of h, using the same finite differences as the filter.
+   * Must be called after InitSystem. The table must have been initialized with
+   * JacobianTable::InitGrid, with n_outputs rows and n_states columns.
+   * @param table The table to fill
+   * @param x_nominal Nominal state, gives the non-scheduling components
+   * @param sensor Index of the sensor
+   */
+  void TabulateH(JacobianTable& table, const colvec& x_nominal, int sensor = 0);
+  
+  /*!
+   * \brief Interpolate the Jacobians from precomputed tables instead of computing them.
+   * The tables are not copied and must outlive the filter, or until this
+   * function is called again. A null table means the Jacobian is computed.
+   * @param F_table Table of the Jacobian of f, or 0
+   * @param H_table Table of the Jacobian of h, or 0
+   * @return False if a table does not fit the filter, none is used then
+   */
+  bool UseJacobianTables(const JacobianTable* F_table, const JacobianTable* H_table);
+  
+  /*!
+   * \brief Interpolate the Jacobian of an additional sensor from a precomputed table.
+   * @param H_table Table of the Jacobian of h(x, sensor), or 0
+   * @param sensor Index of the sensor
+   * @return False if the table does not fit the sensor, it is not used then
+   */
+  bool UseSensorJacobianTable(const JacobianTable* H_table, int sensor);
  
   /*!
    * \brief Do the extended Kalman iteration step-by-step while simulating the system. 
@@ -103,6 +273,24 @@ public:
    */
   void EKalmanf(const colvec& z, const colvec& u);
   
+  /*!
+   * \brief Do only the prior update of the extended Kalman iteration.
+   * Use this together with Update when the sensors run at different rates.
+   * Until the next update, the estimated state is the prior.
+   * @param u The applied input to the system
+   */
+  void Predict(const colvec& u);
+  
+  /*!
+   * \brief Do only the measurement update with a measurement from one sensor.
+   * Only the measurement model and the Jacobian of this sensor are evaluated.
+   * Several updates can follow each other, for example when two sensors 
+   * deliver a measurement at the same time.
+   * @param z The measurement outputs of the sensor
+   * @param sensor Index of the sensor that produced z
+   */
+  void Update(const colvec& z, int sensor);
+  
  /*!
   * @brief Get current simulated true state.
   * @return Current simulated state of the system \f$x_k\f$
@@ -129,7 +317,49 @@ public:
   */
   colvec* GetCurrentEstimatedOutput();
   
+  /*!
+   * @brief Get the log-likelihood of the last measurement.
+   * The density of the innovation under N(0, S), S being the innovation
+   * covariance, for model selection or multiple model filters.
+   * @return Log-likelihood of the last measurement
+   */
+  double GetLogLikelihood();
+  
+  /*!
+   * @brief Get the normalized innovation squared of the last measurement.
+   * Chi-square distributed with n_outputs degrees of freedom when the filter is consistent.
+   * @return innov' S^-1 innov
+   */
+  double GetNIS();
+  
+  /*!
+   * @brief Use another generator for the noise of the simulated system.
+   * The filter does not own it, it must live as long as the filter simulates with it.
+   * @param generator Noise generator, 0 to go back to the own one of the filter
+   */
+  void SetNoiseGenerator(NoiseGenerator* generator);
+  
+  /*!
+   * @brief Get the generator of the noise of the simulated system, to seed it.
+   * @return The generator in use
+   */
+  NoiseGenerator* GetNoiseGenerator();
+  
 private:
+  /*!
+   * \brief Call h(x, sensor) for each column of X, on the thread pool if allowed.
+   * @param X System states, one per column
+   * @param Y h of each column of X, this is a returned value
+   * @param sensor Index of the sensor
+   */
+  void HBatch(const mat &X, mat &Y, int sensor);
+  
+  /*!
+   * \brief Fill xEps_ with the states perturbed for the Jacobians.
+   * @param x System states
+   */
+  void PerturbedStates(const colvec &x);
+  
   /*!
    * \brief Compute the Jacobian of f numerically using  a  small  
    * finite-difference perturbation magnitude. 
@@ -142,18 +372,58 @@ private:
    * \brief Compute the Jacobian of h numerically using  a  small  
    * finite-difference perturbation magnitude.
    * @param x System states
+   * @param sensor Index of the sensor
+   */
+  void CalcH(const colvec &x, int sensor);
+  
+  /*!
+   * \brief Check the relinearization policy for a Jacobian.
+   * @param x Current operating point
+   * @param x_lin Operating point where the Jacobian was computed
+   * @param steps Number of steps the Jacobian has been used
+   * @param relinearize True if the Jacobian was marked for recomputation
+   * @return True if the Jacobian must be recomputed
    */
-  void CalcH(const colvec &x);
+  bool IsLinearizationStale(const colvec& x, const colvec& x_lin, int steps, bool relinearize);
+  
+  /*!
+   * \brief Mark all Jacobians for recomputation at their next use.
+   */
+  void ForceRelinearization();
+  
+  /*!
+   * @brief Measurement model of one sensor.
+   */
+  struct Sensor {
+    int nOutputs;               ///< Number of outputs
+    mat R;                      ///< Measurement noise covariance
+    mat H;                      ///< Jacobian of h, built only when this sensor is updated
+    colvec xLin;                ///< Operating point of H
+    int steps;                  ///< Age of H in steps
+    bool relinearize;           ///< Forces H to be recomputed at the next update
+    const JacobianTable* table; ///< Precomputed Jacobians of h, or 0
+    
+    // Workspace of the update, sized in AddSensor
+    mat hEps;                   ///< Perturbed evaluations of h, one per column
+    mat Ht;                     ///< Transpose of H
+    mat PHt;                    ///< P * H'
+    mat S;                      ///< Innovation covariance
+    InnovationFactor<eT> factor; ///< Cholesky factor of S
+    mat K;                      ///< Kalman gain
+    colvec innov;               ///< Innovation
+  };
 
   mat F_;          ///< Jacobian of F	
-  mat H_;          ///< Jacobian of H
   mat Q_;          ///< Process noise covariance
-  mat R_;          ///< Measurement noise covariance
+  std::vector<Sensor> sensors_; ///< Measurement models, sensor 0 comes from InitSystem
   colvec v_;       ///< Gaussian process noise
   colvec w_;       ///< Gaussian measurement noise
   
-  mat sqrt_Q_;     ///< Process noise stdev
-  mat sqrt_R_;     ///< Measurement noise stdev
+  mat sqrt_Q_;     ///< Lower Cholesky factor of Q, the process noise is sqrt_Q_ v_
+  mat sqrt_R_;     ///< Lower Cholesky factor of R, the measurement noise is sqrt_R_ w_
+  
+  NoiseGenerator noise_;            ///< Own generator of the noise
+  NoiseGenerator* noiseGenerator_;  ///< Generator in use, 0 for noise_
   
 
  
@@ -164,11 +434,41 @@ private:
   mat P_m_;        ///< State covariance after measurement update
   
   colvec z_m_;     ///< Estimated output
+  double logLik_;  ///< Log-likelihood of the last measurement
+  double nis_;     ///< Normalized innovation squared of the last measurement
   
   double epsilon_; ///< Very small number
+  
+  ThreadPool pool_;             ///< Workers for the parallel Jacobians
+  bool modelThreadSafe_;        ///< True if f and h can be called concurrently
+  mat xEps_;                    ///< Perturbed states, one per column
+  mat fEps_;                    ///< Perturbed evaluations of f, one per column
+  
+  mat Ft_;                      ///< Transpose of F, workspace of the prior update
+  mat FP_;                      ///< F * P, workspace of the prior update
+  colvec dx_;                   ///< Distance to the operating point, workspace
+  colvec xw_;                   ///< Next simulated state, workspace
+  colvec Wdx_;                  ///< W * dx_, workspace
+  
+  bool lazyJacobian_;           ///< True if the Jacobians are reused between steps
+  bool relinearize_;            ///< Forces F to be recomputed at the next step
+  double stateThreshold_;       ///< Distance of the state that triggers a relinearization
+  int maxSteps_;                ///< Maximum age of a Jacobian, 0 for no limit
+  double nisThreshold_;         ///< Innovation statistic that triggers a relinearization
+  mat W_;                       ///< Weighting matrix of the state distance
+  colvec xLinF_;                ///< Operating point of F
+  int stepsF_;                  ///< Age of F in steps
+  
+  const JacobianTable* fTable_; ///< Precomputed Jacobians of f, or 0
 
 protected:
   
+  /*!
+   * \brief Thread pool for the batches of model evaluations.
+   * @return The pool, or 0 if the model is evaluated sequentially
+   */
+  ThreadPool* ModelPool();
+  
   int nStates_;   ///< Number of the states
   int nOutputs_;  ///< Number of outputs
   
@@ -176,5 +476,66 @@ protected:
   colvec z_;      ///< Output matrix
 };
 
+/// The extended Kalman filter in double precision
+typedef BasicEKF<double> EKF;
+
+/// The extended Kalman filter in single precision
+typedef BasicEKF<float> fEKF;
+
+/*!
+ * @brief The extended Kalman filter with the model bound at compile time.
+ * Derive MyModel from EKFT<MyModel> instead of EKF, and define f and h in it
+ * with the same signatures, returning the result or writing it in place. The
+ * batches of model evaluations then call MyModel::f and MyModel::h without
+ * virtual dispatch, so the compiler can inline them into the finite-difference Jacobians.
+ * \code
+ * class MyModel : public EKFT<MyModel> {
+ * public:
+ *  colvec f(const colvec &x, const colvec &u) { ... }
+ *  colvec h(const colvec &x) { ... }
+ * };
+ * \endcode
+ * The element type eT is double by default, see BasicEKF.
+ * The single evaluations of a step and the additional sensors still go through
+ * the virtual functions.
+ */
+template <class Model, class eT = double>
+class EKFT : public BasicEKF<eT> {
+public:
+  typedef typename BasicEKF<eT>::mat mat;
+  typedef typename BasicEKF<eT>::colvec colvec;
+
+  using BasicEKF<eT>::h_batch;
+  
+  /*!
+   * \brief Evaluate Model::f at several states, see BasicEKF::f_batch.
+   * @param X System states, one per column
+   * @param u System inputs
+   * @param Y f of each column of X, this is a returned value
+   */
+  virtual void f_batch(const mat &X, const colvec &u, mat &Y) {
+    Model &model = static_cast<Model&>(*this);
+    Y.set_size(this->nStates_, X.n_cols);
+    ForEachColumn(this->ModelPool(), X, [&](uword k, const colvec &x_k) {
+      colvec y_k(Y.colptr(k), Y.n_rows, false, true);
+      CallModelF(model, x_k, u, y_k, 0);
+    });
+  }
+
+  /*!
+   * \brief Evaluate Model::h at several states, see BasicEKF::h_batch.
+   * @param X System states, one per column
+   * @param Y h of each column of X, this is a returned value
+   */
+  virtual void h_batch(const mat &X, mat &Y) {
+    Model &model = static_cast<Model&>(*this);
+    Y.set_size(this->nOutputs_, X.n_cols);
+    ForEachColumn(this->ModelPool(), X, [&](uword k, const colvec &x_k) {
+      colvec y_k(Y.colptr(k), Y.n_rows, false, true);
+      CallModelH(model, x_k, y_k, 0);
+    });
+  }
+};
+
 
 #endif
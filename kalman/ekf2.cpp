@@ -7,23 +7,28 @@
 
 #include "ekf2.h"
 
-EKF2::EKF2()
+template <class eT>
+BasicEKF2<eT>::BasicEKF2()
 {
-
+    modelThreadSafe_ = false;
+    noiseGenerator_ = 0;
 }
 
-EKF2::~EKF2()
+template <class eT>
+BasicEKF2<eT>::~BasicEKF2()
 {
 
 }
 
-void EKF2::InitSystem(int n_states, int n_outputs, const mat& Q, const mat& R)
+template <class eT>
+void BasicEKF2<eT>::InitSystem(int n_states, int n_outputs, const mat& Q, const mat& R)
 {
     assert(Q.is_square() && "Whoops, Q must be a square matrix");
     assert(R.is_square() && "Whoops, R must be a square matrix (n_outputs x n_outputs)");
 
-    // Epsilon for computing the Jacobian numerically
-    epsilon_ = 1e-5;
+    // Epsilon for computing the Jacobian numerically, the second differences
+    // lose half of the about 7 digits of single precision to rounding
+    epsilon_ = (sizeof(eT) == sizeof(float)) ? 1e-2 : 1e-5;
 
     nStates_ = n_states;
     nOutputs_ = n_outputs;
@@ -31,9 +36,9 @@ void EKF2::InitSystem(int n_states, int n_outputs, const mat& Q, const mat& R)
     Q_ = Q;
     R_ = R;
 
-    // Stdev is sqrt of variance
-    sqrt_Q_ = sqrt(Q_);
-    sqrt_R_ = sqrt(R_);
+    // Cholesky factors of the noise covariances, the simulation draws unit noise through them
+    NoiseGenerator::CovarianceFactor(Q_, sqrt_Q_);
+    NoiseGenerator::CovarianceFactor(R_, sqrt_R_);
 
     x_.resize(n_states);
 
@@ -53,235 +58,468 @@ void EKF2::InitSystem(int n_states, int n_outputs, const mat& Q, const mat& R)
     // Inital values for the Kalman iterations
     P_m_ = P_m_.eye();
     x_m_ = x_m_.zeros();
+
+    // Until told otherwise, everything is nonlinear
+    fNonlinear_ = regspace<uvec>(0, n_states - 1);
+    hNonlinear_ = regspace<uvec>(0, n_outputs - 1);
+    nonlinearStates_ = regspace<uvec>(0, n_states - 1);
+
+    // Workspace, the steps only write into these
+    Fx_.set_size(n_states, n_states);
+    Hx_.set_size(n_outputs, n_states);
+    Fxt_.set_size(n_states, n_states);
+    Hxt_.set_size(n_states, n_outputs);
+    FP_.set_size(n_states, n_states);
+    PHt_.set_size(n_states, n_outputs);
+    S_.set_size(n_outputs, n_outputs);
+    factor_.SetSize(n_states, n_outputs);
+    K_.set_size(n_states, n_outputs);
+    innov_.set_size(n_outputs);
+    z_p_.set_size(n_outputs);
+    xw_.set_size(n_states);
+    z_.set_size(n_outputs);
+    z_m_.set_size(n_outputs);
 }
 
-colvec EKF2::f(const colvec &x, const colvec &u)
+template <class eT>
+typename BasicEKF2<eT>::colvec BasicEKF2<eT>::f(const colvec &x, const colvec &u)
 {
     colvec xk(nOutputs_);
     xk = xk.zeros();
     return xk;
 }
 
-colvec EKF2::h(const colvec &x)
+template <class eT>
+typename BasicEKF2<eT>::colvec BasicEKF2<eT>::h(const colvec &x)
 {
     colvec zk(nOutputs_);
     zk = zk.zeros();
     return zk;
 }
 
-mat EKF2::CalcFx(const colvec &x, const colvec &u)
+template <class eT>
+void BasicEKF2<eT>::f(const colvec &x, const colvec &u, colvec &out)
 {
-    mat F;
-    F.resize(nStates_, nStates_);
-    
-    colvec f0 = f(x, u);
-    colvec fn;
+    out = f(x, u);
+}
 
-    for (int j = 0; j < nStates_; j++) {
-        colvec x_eps = x;
-        x_eps(j) = x_eps(j) + epsilon_;
-        fn = f(x_eps, u);
+template <class eT>
+void BasicEKF2<eT>::h(const colvec &x, colvec &out)
+{
+    out = h(x);
+}
 
-        for (int i = 0; i < nStates_; i++) {
-            F(i, j) = (fn(i) - f0(i)) / epsilon_;
-        }
+template <class eT>
+void BasicEKF2<eT>::f_batch(const mat &X, const colvec &u, mat &Y)
+{
+    Y.set_size(nStates_, X.n_cols);
+
+    // The columns of X and Y are passed to f without copying them
+    if (modelThreadSafe_ && pool_.GetNumberOfThreads() > 1) {
+        pool_.ParallelFor(X.n_cols, [&](int k, int t) {
+            const colvec x_k(const_cast<eT*>(X.colptr(k)), X.n_rows, false, true);
+            colvec y_k(Y.colptr(k), Y.n_rows, false, true);
+            f(x_k, u, y_k);
+        });
+        return;
+    }
+
+    for (uword k = 0; k < X.n_cols; k++) {
+        const colvec x_k(const_cast<eT*>(X.colptr(k)), X.n_rows, false, true);
+        colvec y_k(Y.colptr(k), Y.n_rows, false, true);
+        f(x_k, u, y_k);
+    }
+}
+
+template <class eT>
+void BasicEKF2<eT>::h_batch(const mat &X, mat &Y)
+{
+    Y.set_size(nOutputs_, X.n_cols);
+
+    // The columns of X and Y are passed to h without copying them
+    if (modelThreadSafe_ && pool_.GetNumberOfThreads() > 1) {
+        pool_.ParallelFor(X.n_cols, [&](int k, int t) {
+            const colvec x_k(const_cast<eT*>(X.colptr(k)), X.n_rows, false, true);
+            colvec y_k(Y.colptr(k), Y.n_rows, false, true);
+            h(x_k, y_k);
+        });
+        return;
+    }
+
+    for (uword k = 0; k < X.n_cols; k++) {
+        const colvec x_k(const_cast<eT*>(X.colptr(k)), X.n_rows, false, true);
+        colvec y_k(Y.colptr(k), Y.n_rows, false, true);
+        h(x_k, y_k);
     }
+}
+
+template <class eT>
+void BasicEKF2<eT>::PerturbedStates(const colvec &x)
+{
+    // Column j holds x + epsilon * e_j, the last column holds x
+    xEps_.set_size(nStates_, nStates_ + 1);
+    xEps_.each_col() = x;
+    xEps_.diag() += epsilon_;
+}
+
+template <class eT>
+void BasicEKF2<eT>::CalcFx(const colvec &x, const colvec &u, mat &F)
+{
+    F.set_size(nStates_, nStates_);
+
+    PerturbedStates(x);
+    f_batch(xEps_, u, fEps_);
+
+    for (int j = 0; j < nStates_; j++)
+        F.col(j) = (fEps_.col(j) - fEps_.col(nStates_)) / epsilon_;
 
     //F_.print();
-    return F;
 }
 
-mat EKF2::CalcHx(const colvec &x)
+template <class eT>
+void BasicEKF2<eT>::CalcHx(const colvec &x, mat &H)
 {
-    mat H;
-    H.resize(nOutputs_, nStates_);
-    
-    colvec h0 = h(x);
-    colvec hn;
+    H.set_size(nOutputs_, nStates_);
 
-    for (int j = 0; j < nStates_; j++) {
-        colvec x_eps = x; 
-        x_eps(j) = x_eps(j) + epsilon_;
-        hn = h(x_eps);
+    PerturbedStates(x);
+    h_batch(xEps_, hEps_);
 
-        for (int i = 0; i < nOutputs_; i++)
-            H(i, j) = (hn(i) - h0(i)) / epsilon_;
-    }
+    for (int j = 0; j < nStates_; j++)
+        H.col(j) = (hEps_.col(j) - hEps_.col(nStates_)) / epsilon_;
 
     //H_.print();
-    return H;
-}
-
-mat EKF2::CalcFxx(const colvec &x, const colvec &u, const int i)
-{
-    mat F2;
-    F2.resize(nStates_, nStates_);
-    
-    for (int j = 0; j < nStates_; j++) {
-        
-        colvec x0 = x;
-        x0(j) = x0(j) + epsilon_;
-        mat F_plus = CalcFx(x0, u);
-    
-        x0 = x;
-        x0(j) = x0(j) - epsilon_;
-        mat F_min = CalcFx(x0, u);
-        
-        rowvec dF = (F_plus.row(i) - F_min.row(i)) / (2 * epsilon_);
-        F2.row(j) = dF;
+}
+
+template <class eT>
+void BasicEKF2<eT>::BuildStencil(const colvec &x)
+{
+    int n = nStates_;
+    int n_nl = nonlinearStates_.n_elem;
+
+    // The rounding error of a second difference is about the rounding of f over
+    // the squared step. Taking f to grow like the state, the step grows like the
+    // square root of the state, and that error stays put for large states. The
+    // step is the one the element type represents, (x + h) - x, so the
+    // differences divide by the step actually taken
+    step_.set_size(n);
+    for (int j = 0; j < n; j++) {
+        eT xh = x(j) + (eT)(epsilon_ * sqrt(max(fabs((double)x(j)), 1.0)));
+        step_(j) = xh - x(j);
+    }
+
+    // x, then x +/- h_j e_j, then x +/- (h_j e_j + h_k e_k) for the
+    // pairs j < k of nonlinear states
+    stencil_.set_size(n, 1 + 2 * n + n_nl * (n_nl - 1));
+    stencil_.each_col() = x;
+
+    for (int j = 0; j < n; j++) {
+        stencil_(j, 1 + j) = stencil_(j, 1 + j) + step_(j);
+        stencil_(j, 1 + n + j) = stencil_(j, 1 + n + j) - step_(j);
+    }
+
+    int c = 1 + 2 * n;
+    for (int a = 0; a < n_nl; a++) {
+        for (int b = a + 1; b < n_nl; b++) {
+            uword j = nonlinearStates_(a);
+            uword k = nonlinearStates_(b);
+            stencil_(j, c) = stencil_(j, c) + step_(j);
+            stencil_(k, c) = stencil_(k, c) + step_(k);
+            stencil_(j, c + 1) = stencil_(j, c + 1) - step_(j);
+            stencil_(k, c + 1) = stencil_(k, c + 1) - step_(k);
+            c = c + 2;
+        }
+    }
+}
+
+template <class eT>
+void BasicEKF2<eT>::AssembleDerivatives(const mat &y, const uvec &nonlinear, mat &J, cube &Hess)
+{
+    int n = nStates_;
+    int n_nl = nonlinearStates_.n_elem;
+
+    J.set_size(y.n_rows, n);
+    Hess.zeros(n, n, y.n_rows);
+
+    // Central differences for the Jacobian
+    for (int j = 0; j < n; j++)
+        J.col(j) = (y.col(1 + j) - y.col(1 + n + j)) / (2 * step_(j));
+
+    // Diagonal of the Hessians, only the nonlinear components and states
+    for (uword l = 0; l < nonlinear.n_elem; l++) {
+        uword i = nonlinear(l);
+        for (int a = 0; a < n_nl; a++) {
+            uword j = nonlinearStates_(a);
+            double h2 = (double)step_(j) * step_(j);
+            Hess(j, j, i) = (y(i, 1 + j) - 2 * y(i, 0) + y(i, 1 + n + j)) / h2;
+        }
     }
-    
-    //F2.print("F2");
-    return F2;
-}
-
-mat EKF2::CalcHxx(const colvec &x, const int i)
-{
-    mat H2;
-    H2.resize(nStates_, nStates_);
-    
-    for (int j = 0; j < nStates_; j++) {
-        
-        colvec x0 = x;
-        x0(j) = x0(j) + epsilon_;
-        mat H_plus = CalcHx(x0);
-    
-        x0 = x;
-        x0(j) = x0(j) - epsilon_;
-        mat H_min = CalcHx(x0);
-       
-        rowvec dH = (H_plus.row(i) - H_min.row(i)) / (2 * epsilon_);
-        H2.row(j) = dH;
+
+    // Off-diagonal terms, second order accurate, mirrored to the lower triangle
+    int c = 1 + 2 * n;
+    for (int a = 0; a < n_nl; a++) {
+        for (int b = a + 1; b < n_nl; b++) {
+            uword j = nonlinearStates_(a);
+            uword k = nonlinearStates_(b);
+            for (uword l = 0; l < nonlinear.n_elem; l++) {
+                uword i = nonlinear(l);
+                double d = y(i, c) + y(i, c + 1) + 2 * y(i, 0)
+                    - y(i, 1 + j) - y(i, 1 + n + j) - y(i, 1 + k) - y(i, 1 + n + k);
+                Hess(j, k, i) = d / (2 * (double)step_(j) * step_(k));
+                Hess(k, j, i) = Hess(j, k, i);
+            }
+            c = c + 2;
+        }
     }
-    
-    //H2.print("H2");
-    return H2;
 }
 
-colvec EKF2::e(const int i, const int max_len)
+template <class eT>
+void BasicEKF2<eT>::CalcFxx(const colvec &x, const colvec &u, mat &Fx, cube &Fxx)
 {
-    colvec temp(zeros(max_len));
-    temp(i) = 1;
-    return temp;
+    BuildStencil(x);
+    f_batch(stencil_, u, stencilValues_);
+    AssembleDerivatives(stencilValues_, fNonlinear_, Fx, Fxx);
+
+    //Fxx.print("Fxx");
 }
 
+template <class eT>
+void BasicEKF2<eT>::CalcHxx(const colvec &x, mat &Hx, cube &Hxx)
+{
+    BuildStencil(x);
+    h_batch(stencil_, hStencilValues_);
+    AssembleDerivatives(hStencilValues_, hNonlinear_, Hx, Hxx);
+
+    //Hxx.print("Hxx");
+}
 
-void EKF2::InitSystemState(const colvec& x0)
+template <class eT>
+void BasicEKF2<eT>::SecondOrderTerms(const cube &Hess, const uvec &nonlinear, const mat &P, colvec &trHP, colvec &trHPHP)
+{
+    trHP.zeros(Hess.n_slices);
+    trHPHP.zeros(Hess.n_slices);
+
+    // The Hessians are zero outside of the rows and columns of the nonlinear
+    // states, so both traces only need that block of P, gathered once
+    const uword m = nonlinearStates_.n_elem;
+    Pnl_.set_size(m, m);
+    Hnl_.set_size(m, m);
+    for (uword b = 0; b < m; b++) {
+        for (uword a = 0; a < m; a++)
+            Pnl_(a, b) = P(nonlinearStates_(a), nonlinearStates_(b));
+    }
+
+    for (uword l = 0; l < nonlinear.n_elem; l++) {
+        uword i = nonlinear(l);
+        const mat &H = Hess.slice(i);
+        for (uword b = 0; b < m; b++) {
+            for (uword a = 0; a < m; a++)
+                Hnl_(a, b) = H(nonlinearStates_(a), nonlinearStates_(b));
+        }
+
+        // trace(Hess_i * P) is an elementwise dot product, P being symmetric
+        trHP(i) = dot(Hnl_, Pnl_);
+
+        // trace(A * A), with A = Hess_i * P, is the sum of A(j, k) * A(k, j)
+        HP_ = Hnl_ * Pnl_;
+        double sum = 0;
+        for (uword k = 0; k < m; k++) {
+            sum = sum + HP_(k, k) * HP_(k, k);
+            for (uword j = k + 1; j < m; j++)
+                sum = sum + 2 * HP_(j, k) * HP_(k, j);
+        }
+        trHPHP(i) = sum;
+    }
+}
+
+template <class eT>
+void BasicEKF2<eT>::SetLinearComponents(const uvec& f_linear, const uvec& h_linear)
+{
+    assert((f_linear.is_empty() || f_linear.max() < (uword)nStates_) && "Whoops, f does not have that many elements");
+    assert((h_linear.is_empty() || h_linear.max() < (uword)nOutputs_) && "Whoops, h does not have that many elements");
+
+    // Keep the complements, those are the ones to work on
+    uvec f_flag(ones<uvec>(nStates_));
+    uvec h_flag(ones<uvec>(nOutputs_));
+    f_flag.elem(f_linear).zeros();
+    h_flag.elem(h_linear).zeros();
+    fNonlinear_ = find(f_flag);
+    hNonlinear_ = find(h_flag);
+}
+
+template <class eT>
+void BasicEKF2<eT>::SetNonlinearStates(const uvec& states)
+{
+    assert((states.is_empty() || states.max() < (uword)nStates_) && "Whoops, there are not that many states");
+
+    nonlinearStates_ = sort(unique(states));
+}
+
+template <class eT>
+void BasicEKF2<eT>::SetModelThreadSafe(bool thread_safe)
+{
+    modelThreadSafe_ = thread_safe;
+}
+
+template <class eT>
+void BasicEKF2<eT>::SetJacobianThreads(int n_threads)
+{
+    assert(n_threads > 0 && "Whoops, at least one thread is needed");
+
+    pool_.Start(n_threads);
+}
+
+template <class eT>
+void BasicEKF2<eT>::InitSystemState(const colvec& x0)
 {
     arma_assert_same_size(x_.n_rows, x_.n_cols, x0.n_rows, x0.n_cols, "Whoops, error initializing system states");
     x_ = x0;
     x_m_ = x0;
 }
 
-void EKF2::InitSystemStateCovariance(const mat& P0)
+template <class eT>
+void BasicEKF2<eT>::InitSystemStateCovariance(const mat& P0)
 {
     arma_assert_same_size(P0.n_rows, P0.n_cols, P_m_.n_rows, P_m_.n_cols, "Whoops, error initializing state covariance");
     P_m_ = P0;
 }
 
-void EKF2::EKalmanf(const colvec& u)
+template <class eT>
+void BasicEKF2<eT>::EKalmanf(const colvec& u)
 {
     // Simulate true system, with noise
-    // randn uses a normal/Gaussian distribution with zero mean and unit variance
-    v_.randn(nStates_);
-    w_.randn(nOutputs_);
-    v_ = sqrt_Q_ * v_;
-    w_ = sqrt_R_ * w_;
-    x_ = f(x_, u) + v_;
-    z_ = h(x_) + w_;
-
-    mat Fx = CalcFx(x_m_, u);
-        
+    // Unit Gaussian noise from the generator of the filter
+    GetNoiseGenerator()->Gaussian(v_);
+    GetNoiseGenerator()->Gaussian(w_);
+    f(x_, u, xw_);
+    x_ = xw_;
+    x_ += sqrt_Q_ * v_;
+    h(x_, z_);
+    z_ += sqrt_R_ * w_;
+
+    EKalmanf(z_, u);
+}
+
+template <class eT>
+void BasicEKF2<eT>::EKalmanf(const colvec& z, const colvec& u)
+{
     // Prior update:
-    mat FxxP(zeros(nStates_, 1));
-    mat FxxPFxxP(zeros(nStates_, nStates_));
-    for (int i = 0; i < nStates_; i ++) {
-        mat temp = CalcFxx(x_m_, u, i) * P_m_;
-        FxxP = FxxP + e(i, nStates_) * trace(temp);
-        FxxPFxxP = FxxPFxxP + e(i, nStates_) * trans(e(i, nStates_)) * trace(temp * temp);
+    if (fNonlinear_.is_empty() || nonlinearStates_.is_empty()) {
+        // f is linear, this is the plain EKF propagation
+        CalcFx(x_m_, u, Fx_);
+        f(x_m_, u, x_p_);
     }
-    
-    x_p_ = f(x_m_, u) + 0.5 * FxxP;
-    P_p_ = Fx * P_m_ * trans(Fx) + 0.5 * FxxPFxxP + Q_;
+    else {
+        // Jacobian and Hessians of f, all from one shared stencil
+        CalcFxx(x_m_, u, Fx_, Fxx_);
+        SecondOrderTerms(Fxx_, fNonlinear_, P_m_, trFP_, trFPFP_);
 
-    mat Hx = CalcHx(x_p_);
-    
-    // Measurement update:
-    colvec HxxP(zeros(nOutputs_));
-    colvec HxxPHxxP(zeros(nOutputs_));
-    for (int i = 0; i < nOutputs_; i ++) {
-        mat temp = CalcHxx(x_p_, i) * P_p_;
-        HxxP = HxxP + e(i, nOutputs_) * trace(temp);
-        HxxPHxxP = HxxPHxxP + e(i, nOutputs_) * trans(e(i, nOutputs_)) * trace(temp * temp);
+        // The first point of the stencil is x_m_ itself
+        x_p_ = stencilValues_.col(0) + 0.5 * trFP_;
     }
-    
-    mat z_p = h(x_p_) + 0.5 * HxxP;
-    mat S = Hx * P_p_ * trans(Hx) + 0.5 * HxxPHxxP + R_;
-    mat K = P_p_ * trans(Hx) * inv(S);
-    x_m_ = x_p_ + K * (z_ - z_p);
-    P_m_ = P_p_ - K * S * trans(K);
 
-    // Estimated output is the projection of etimated states to the output function
-    z_m_ = h(x_m_);
-}
+    // P_p = Fx * P_m * Fx' + Q
+    Fxt_ = trans(Fx_);
+    SmallMat::Sandwich(Fx_, P_m_, Fxt_, FP_, P_p_);
+    P_p_ += Q_;
+    if (!fNonlinear_.is_empty() && !nonlinearStates_.is_empty())
+        P_p_.diag() += 0.5 * trFPFP_;
 
-void EKF2::EKalmanf(const colvec& z, const colvec& u)
-{
-    mat Fx = CalcFx(x_m_, u);
-        
-    // Prior update:
-    mat FxxP(zeros(nStates_, 1));
-    mat FxxPFxxP(zeros(nStates_, nStates_));
-    for (int i = 0; i < nStates_; i ++) {
-        mat temp = CalcFxx(x_m_, u, i) * P_m_;
-        FxxP = FxxP + e(i, nStates_) * trace(temp);
-        FxxPFxxP = FxxPFxxP + e(i, nStates_) * trans(e(i, nStates_)) * trace(temp * temp);
+    // Measurement update:
+    if (hNonlinear_.is_empty() || nonlinearStates_.is_empty()) {
+        // h is linear, this is the plain EKF correction
+        CalcHx(x_p_, Hx_);
+        h(x_p_, z_p_);
     }
-    
-    x_p_ = f(x_m_, u) + 0.5 * FxxP;
-    P_p_ = Fx * P_m_ * trans(Fx) + 0.5 * FxxPFxxP + Q_;
+    else {
+        // Jacobian and Hessians of h, all from one shared stencil
+        CalcHxx(x_p_, Hx_, Hxx_);
+        SecondOrderTerms(Hxx_, hNonlinear_, P_p_, trHP_, trHPHP_);
 
-    mat Hx = CalcHx(x_p_);
-    
-    // Measurement update:
-    colvec HxxP(zeros(nOutputs_));
-    colvec HxxPHxxP(zeros(nOutputs_));
-    for (int i = 0; i < nOutputs_; i ++) {
-        mat temp = CalcHxx(x_p_, i) * P_p_;
-        HxxP = HxxP + e(i, nOutputs_) * trace(temp);
-        HxxPHxxP = HxxPHxxP + e(i, nOutputs_) * trans(e(i, nOutputs_)) * trace(temp * temp);
+        z_p_ = hStencilValues_.col(0) + 0.5 * trHP_;
     }
-    
-    mat z_p = h(x_p_) + 0.5 * HxxP;
-    mat S = Hx * P_p_ * trans(Hx) + 0.5 * HxxPHxxP + R_;
-    mat K = P_p_ * trans(Hx) * inv(S);
-    x_m_ = x_p_ + K * (z - z_p);
-    P_m_ = P_p_ - K * S * trans(K);
+
+    // S = Hx * P_p * Hx' + R
+    Hxt_ = trans(Hx_);
+    SmallMat::Multiply(P_p_, Hxt_, PHt_);
+    SmallMat::Multiply(Hx_, PHt_, S_);
+    S_ += R_;
+    if (!hNonlinear_.is_empty() && !nonlinearStates_.is_empty())
+        S_.diag() += 0.5 * trHPHP_;
+
+    // K = P_p * Hx' * S^-1, from the Cholesky factor of S
+    factor_.Factor(S_);
+    factor_.Gain(PHt_, K_);
+
+    innov_ = z;
+    innov_ -= z_p_;
+    factor_.Evaluate(innov_);
+    x_m_ = x_p_;
+    x_m_ += K_ * innov_;
+
+    // P_m = P_p - K * S * K'
+    P_m_ = P_p_;
+    factor_.Downdate(P_m_);
 
     // Estimated output is the projection of etimated states to the output function
-    z_m_ = h(x_m_);
+    h(x_m_, z_m_);
 }
 
-colvec* EKF2::GetCurrentState()
+template <class eT>
+typename BasicEKF2<eT>::colvec* BasicEKF2<eT>::GetCurrentState()
 {
     return &x_;
 }
 
-colvec* EKF2::GetCurrentOutput()
+template <class eT>
+typename BasicEKF2<eT>::colvec* BasicEKF2<eT>::GetCurrentOutput()
 {
     return &z_;
 }
 
-colvec* EKF2::GetCurrentEstimatedState()
+template <class eT>
+typename BasicEKF2<eT>::colvec* BasicEKF2<eT>::GetCurrentEstimatedState()
 {
     return &x_m_;
 }
 
 
-colvec* EKF2::GetCurrentEstimatedOutput()
+template <class eT>
+typename BasicEKF2<eT>::colvec* BasicEKF2<eT>::GetCurrentEstimatedOutput()
 {
     return &z_m_;
 }
 
+template <class eT>
+double BasicEKF2<eT>::GetLogLikelihood()
+{
+    return factor_.GetLogLikelihood();
+}
 
+template <class eT>
+double BasicEKF2<eT>::GetNIS()
+{
+    return factor_.GetNIS();
+}
+
+template <class eT>
+ThreadPool* BasicEKF2<eT>::ModelPool()
+{
+    if (modelThreadSafe_ && pool_.GetNumberOfThreads() > 1)
+        return &pool_;
+    return 0;
+}
+
+template <class eT>
+void BasicEKF2<eT>::SetNoiseGenerator(NoiseGenerator* generator)
+{
+    noiseGenerator_ = generator;
+}
+
+template <class eT>
+NoiseGenerator* BasicEKF2<eT>::GetNoiseGenerator()
+{
+    return noiseGenerator_ ? noiseGenerator_ : &noise_;
+}
 
+template class BasicEKF2<float>;
+template class BasicEKF2<double>;
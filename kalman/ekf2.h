@@ -31,24 +31,37 @@
 #include <assert.h>
 #include <armadillo>
 
+#include "innovation.h"
+#include "smallmat.h"
+#include "noise.h"
+#include "threadpool.h"
+#include "model_call.h"
+
 using namespace std;
 using namespace arma;
 
 /*!
  * @brief Implemetation of the extended Kalman filter.
  * This class needs to be derived.
+ * The element type eT is float or double, see EKF2 and fEKF2. Inside the
+ * filter and its derived classes, mat, colvec and cube are of that type.
  */
-class EKF2 {
+template <class eT>
+class BasicEKF2 {
 public:
+    typedef Mat<eT> mat;      ///< Matrix of the element type
+    typedef Col<eT> colvec;   ///< Column vector of the element type
+    typedef Cube<eT> cube;    ///< Cube of the element type
+
     /*!
      * \brief Constructor, nothing happens here.
      */
-    EKF2();
+    BasicEKF2();
 
     /*!
      * \brief Destructur, nothing happens here.
      */
-    ~EKF2();
+    ~BasicEKF2();
 
     /*!
      * \brief Tell me how many states and outputs you have!
@@ -71,6 +84,45 @@ public:
      */
     virtual colvec h(const colvec &x);
 
+    /*!
+     * \brief Define model of your system, writing the result in place.
+     * Override this one instead of f(x, u) and no vector is returned by value:
+     * the filter always evaluates f through it. The default calls f(x, u).
+     * out is never x, and already has its size, out.set_size with that same
+     * size is allowed.
+     * @param x System states
+     * @param u System inputs
+     * @param out f(x, u), this is a returned value
+     */
+    virtual void f(const colvec &x, const colvec &u, colvec &out);
+
+    /*!
+     * \brief Define the output model of your system, writing the result in place.
+     * Same as f(x, u, out), the default calls h(x).
+     * @param x System states
+     * @param out h(x), this is a returned value
+     */
+    virtual void h(const colvec &x, colvec &out);
+
+    /*!
+     * \brief Evaluate f at several states in one call.
+     * The filter evaluates its multi-point sets (the perturbed states and the
+     * Hessian stencil) through this function. Override it to vectorize the model
+     * over the columns. The default calls f for each column, on the thread pool
+     * if SetModelThreadSafe(true) and SetJacobianThreads were called.
+     * @param X System states, one per column
+     * @param u System inputs
+     * @param Y f of each column of X, this is a returned value
+     */
+    virtual void f_batch(const mat &X, const colvec &u, mat &Y);
+
+    /*!
+     * \brief Evaluate h at several states in one call, see f_batch.
+     * @param X System states, one per column
+     * @param Y h of each column of X, this is a returned value
+     */
+    virtual void h_batch(const mat &X, mat &Y);
+
     /*!
      * \brief Initialize the system states.
      * Must be called after InitSystem.
@@ -87,6 +139,45 @@ public:
      */
     void InitSystemStateCovariance(const mat& P0);
 
+    /*!
+     * \brief Declare the elements of f and h that are linear (or affine) in x.
+     * Their Hessians are zero, so they are neither computed nor used in the
+     * second order terms. If all elements of f (or h) are linear, the prior
+     * (or measurement) update falls back to the plain first order EKF.
+     * Must be called after InitSystem. If not called, everything is nonlinear.
+     * @param f_linear Indices of the linear elements of f
+     * @param h_linear Indices of the linear elements of h
+     */
+    void SetLinearComponents(const uvec& f_linear, const uvec& h_linear);
+
+    /*!
+     * \brief Declare the states that f and h depend nonlinearly on.
+     * The Hessians are only computed over these states, the rows and columns
+     * of the other states are zero. The stencil then needs m (m - 1) instead of
+     * n (n - 1) evaluations for the mixed terms, m being the number of these states.
+     * Must be called after InitSystem. If not called, all states are nonlinear.
+     * @param states Indices of the nonlinear states
+     */
+    void SetNonlinearStates(const uvec& states);
+
+    /*!
+     * \brief Declare that f and h are reentrant and can be called concurrently.
+     * This is a contract from the user: f and h must not modify shared data.
+     * Without it, the Jacobians and the Hessians are always computed sequentially.
+     * @param thread_safe True if f and h can be called from several threads
+     */
+    void SetModelThreadSafe(bool thread_safe);
+
+    /*!
+     * \brief Compute the Jacobians and the Hessian stencils of f and h in parallel.
+     * The perturbed models are evaluated on a persistent thread pool, by the
+     * default f_batch and h_batch.
+     * This only pays off when f or h are expensive, and it only takes effect
+     * after SetModelThreadSafe(true).
+     * @param n_threads Number of threads, including the calling thread, 1 disables it
+     */
+    void SetJacobianThreads(int n_threads);
+
     /*!
      * \brief Do the extended Kalman iteration step-by-step while simulating the system.
      * Simulating the system is done to calculate system states and outputs.
@@ -130,55 +221,146 @@ public:
      */
     colvec* GetCurrentEstimatedOutput();
 
+    /*!
+     * @brief Get the log-likelihood of the last measurement.
+     * The density of the innovation under N(0, S), S being the innovation
+     * covariance, for model selection or multiple model filters.
+     * @return Log-likelihood of the last measurement
+     */
+    double GetLogLikelihood();
+
+    /*!
+     * @brief Get the normalized innovation squared of the last measurement.
+     * Chi-square distributed with n_outputs degrees of freedom when the filter is consistent.
+     * @return innov' S^-1 innov
+     */
+    double GetNIS();
+
+    /*!
+     * @brief Use another generator for the noise of the simulated system.
+     * The filter does not own it, it must live as long as the filter simulates with it.
+     * @param generator Noise generator, 0 to go back to the own one of the filter
+     */
+    void SetNoiseGenerator(NoiseGenerator* generator);
+
+    /*!
+     * @brief Get the generator of the noise of the simulated system, to seed it.
+     * @return The generator in use
+     */
+    NoiseGenerator* GetNoiseGenerator();
+
 private:
+    /*!
+     * \brief Fill xEps_ with the states perturbed for the Jacobians.
+     * @param x System states
+     */
+    void PerturbedStates(const colvec &x);
+
     /*!
      * \brief Compute the Jacobian of f numerically using  a  small
      * finite-difference perturbation magnitude.
      * @param x System states
      * @param u Input vector
+     * @param F Jacobian of f, this is a returned value
      */
-    mat CalcFx(const colvec &x, const colvec &u);
+    void CalcFx(const colvec &x, const colvec &u, mat &F);
 
     /*!
      * \brief Compute the Jacobian of h numerically using  a  small
      * finite-difference perturbation magnitude.
      * @param x System states
+     * @param H Jacobian of h, this is a returned value
      */
-    mat CalcHx(const colvec &x);
+    void CalcHx(const colvec &x, mat &H);
 
     /*!
-     * \brief Compute the Hessian of f numerically using  a  small
-     * finite-difference perturbation magnitude.
+     * \brief Fill the finite-difference stencil shared by the Jacobian and all the Hessians.
+     * The stencil holds x, x +/- epsilon e_j and, for the upper triangle of the
+     * nonlinear states only, x +/- epsilon (e_j + e_k). That is n^2 + n + 1 points
+     * when all states are nonlinear.
+     * @param x Center of the stencil
+     */
+    void BuildStencil(const colvec &x);
+
+    /*!
+     * \brief Compute the Jacobian and the Hessians from the stencil.
+     * Hessians of the linear components are left to zero.
+     * @param y Function values at the stencil points, one column per point
+     * @param nonlinear Indices of the nonlinear components
+     * @param J Jacobian, this is a returned value
+     * @param Hess Hessians, slice i is the Hessian of the i-th component, this is a returned value
+     */
+    void AssembleDerivatives(const mat &y, const uvec &nonlinear, mat &J, cube &Hess);
+
+    /*!
+     * \brief Compute the Jacobian and the Hessians of all components of f numerically,
+     * from one shared stencil of at most n^2 + n + 1 evaluations of f.
      * @param x System states
      * @param u Input vector
-     * @param i i-th element of function f
+     * @param Fx Jacobian of f, this is a returned value
+     * @param Fxx Hessians of f, slice i belongs to the i-th element of f, this is a returned value
      */
-    mat CalcFxx(const colvec &x, const colvec &u, const int i);
+    void CalcFxx(const colvec &x, const colvec &u, mat &Fx, cube &Fxx);
 
     /*!
-     * \brief Compute the Hessian of h numerically using  a  small
-     * finite-difference perturbation magnitude.
+     * \brief Compute the Jacobian and the Hessians of all components of h numerically,
+     * from one shared stencil of at most n^2 + n + 1 evaluations of h.
      * @param x System states
-     * @param u Input vector
-     * @param i i-th element of function f
+     * @param Hx Jacobian of h, this is a returned value
+     * @param Hxx Hessians of h, slice i belongs to the i-th element of h, this is a returned value
      */
-    mat CalcHxx(const colvec &x, const int i);
+    void CalcHxx(const colvec &x, mat &Hx, cube &Hxx);
     
-   /*!
-    * \brief Create a unit vector in direction of the coordinate axis i, that is, it has a 1 at position i and 0 at other positions.
-    * @param i Axis i, starts from 0
-    * @param max_len Maximum length of the vector
-    * @return A unit vector, for example: ei = (0 · · · 0 1 0 · · · 0)' 
-    */
-    colvec e(const int i, const int max_len);
+    /*!
+     * \brief Compute the traces needed by the second order terms, for the nonlinear components.
+     * Only the diagonal of the second order covariance term is non-zero, so
+     * both traces are returned as vectors. Entries of the linear components are zero.
+     * The Hessians only have the rows and columns of the nonlinear states, so
+     * each component costs one product of that size, m^3 for m nonlinear states.
+     * @param Hess Hessians, one slice per component
+     * @param nonlinear Indices of the nonlinear components
+     * @param P State covariance
+     * @param trHP trace(Hess_i * P), this is a returned value
+     * @param trHPHP trace(Hess_i * P * Hess_i * P), this is a returned value
+     */
+    void SecondOrderTerms(const cube &Hess, const uvec &nonlinear, const mat &P, colvec &trHP, colvec &trHPHP);
+
+    mat Fx_;         ///< Jacobian of f
+    mat Hx_;         ///< Jacobian of h
+    cube Fxx_;       ///< Hessians of f, one slice per element of f
+    cube Hxx_;       ///< Hessians of h, one slice per element of h
+
+    colvec trFP_;    ///< trace(Fxx_i * P), per element of f
+    colvec trFPFP_;  ///< trace(Fxx_i * P * Fxx_i * P), per element of f
+    colvec trHP_;    ///< trace(Hxx_i * P), per element of h
+    colvec trHPHP_;  ///< trace(Hxx_i * P * Hxx_i * P), per element of h
+    mat Pnl_;        ///< Workspace, the covariance of the nonlinear states
+    mat Hnl_;        ///< Workspace, a Hessian over the nonlinear states
+    mat HP_;         ///< Workspace, Hnl_ * Pnl_
+
+    colvec z_p_;     ///< Predicted output
+    mat S_;          ///< Innovation covariance
+    mat K_;          ///< Kalman gain
+
+    mat stencil_;       ///< Points of the finite-difference stencil, one per column
+    colvec step_;       ///< Step of each state in the stencil
+    mat stencilValues_; ///< Values of f at the stencil points, the first one is at the center
+    mat hStencilValues_; ///< Values of h at the stencil points, the first one is at the center
+
+    uvec fNonlinear_;      ///< Indices of the nonlinear elements of f
+    uvec hNonlinear_;      ///< Indices of the nonlinear elements of h
+    uvec nonlinearStates_; ///< Indices of the states entering f and h nonlinearly
 
     mat Q_;          ///< Process noise covariance
     mat R_;          ///< Measurement noise covariance
     colvec v_;       ///< Gaussian process noise
     colvec w_;       ///< Gaussian measurement noise
 
-    mat sqrt_Q_;     ///< Process noise stdev
-    mat sqrt_R_;     ///< Measurement noise stdev
+    mat sqrt_Q_;     ///< Lower Cholesky factor of Q, the process noise is sqrt_Q_ v_
+    mat sqrt_R_;     ///< Lower Cholesky factor of R, the measurement noise is sqrt_R_ w_
+
+    NoiseGenerator noise_;            ///< Own generator of the noise
+    NoiseGenerator* noiseGenerator_;  ///< Generator in use, 0 for noise_
 
     colvec x_m_;     ///< State vector after measurement update
     colvec x_p_;     ///< State vector after a priori update
@@ -190,8 +372,29 @@ private:
 
     double epsilon_; ///< Very small number
 
+    ThreadPool pool_;             ///< Workers for the parallel Jacobians and Hessians
+    bool modelThreadSafe_;        ///< True if f and h can be called concurrently
+    mat xEps_;                    ///< Perturbed states, one per column
+    mat fEps_;                    ///< Perturbed evaluations of f, one per column
+    mat hEps_;                    ///< Perturbed evaluations of h, one per column
+
+    // Workspace of the steps, sized in InitSystem
+    mat Fxt_;        ///< Transpose of Fx_
+    mat Hxt_;        ///< Transpose of Hx_
+    mat FP_;         ///< Fx * P_m
+    mat PHt_;        ///< P_p * Hx'
+    InnovationFactor<eT> factor_; ///< Cholesky factor of S_
+    colvec innov_;   ///< Innovation
+    colvec xw_;      ///< Next simulated state
+
 protected:
 
+    /*!
+     * \brief Thread pool for the batches of model evaluations.
+     * @return The pool, or 0 if the model is evaluated sequentially
+     */
+    ThreadPool* ModelPool();
+
     int nStates_;   ///< Number of the states
     int nOutputs_;  ///< Number of outputs
 
@@ -199,5 +402,63 @@ protected:
     colvec z_;      ///< Output matrix
 };
 
+/// The second order extended Kalman filter in double precision
+typedef BasicEKF2<double> EKF2;
+
+/// The second order extended Kalman filter in single precision
+typedef BasicEKF2<float> fEKF2;
+
+/*!
+ * @brief The second order extended Kalman filter with the model bound at compile time.
+ * Derive MyModel from EKF2T<MyModel> instead of EKF2, and define f and h in it
+ * with the same signatures, returning the result or writing it in place. The
+ * batches of model evaluations then call MyModel::f and MyModel::h without
+ * virtual dispatch, so the compiler can inline them into the Jacobian and Hessian stencils.
+ * \code
+ * class MyModel : public EKF2T<MyModel> {
+ * public:
+ *    colvec f(const colvec &x, const colvec &u) { ... }
+ *    colvec h(const colvec &x) { ... }
+ * };
+ * \endcode
+ * The element type eT is double by default, see BasicEKF2.
+ * The single evaluations of a step still go through the virtual functions.
+ */
+template <class Model, class eT = double>
+class EKF2T : public BasicEKF2<eT> {
+public:
+    typedef typename BasicEKF2<eT>::mat mat;
+    typedef typename BasicEKF2<eT>::colvec colvec;
+
+    /*!
+     * \brief Evaluate Model::f at several states, see BasicEKF2::f_batch.
+     * @param X System states, one per column
+     * @param u System inputs
+     * @param Y f of each column of X, this is a returned value
+     */
+    virtual void f_batch(const mat &X, const colvec &u, mat &Y) {
+        Model &model = static_cast<Model&>(*this);
+        Y.set_size(this->nStates_, X.n_cols);
+        ForEachColumn(this->ModelPool(), X, [&](uword k, const colvec &x_k) {
+            colvec y_k(Y.colptr(k), Y.n_rows, false, true);
+            CallModelF(model, x_k, u, y_k, 0);
+        });
+    }
+
+    /*!
+     * \brief Evaluate Model::h at several states, see BasicEKF2::h_batch.
+     * @param X System states, one per column
+     * @param Y h of each column of X, this is a returned value
+     */
+    virtual void h_batch(const mat &X, mat &Y) {
+        Model &model = static_cast<Model&>(*this);
+        Y.set_size(this->nOutputs_, X.n_cols);
+        ForEachColumn(this->ModelPool(), X, [&](uword k, const colvec &x_k) {
+            colvec y_k(Y.colptr(k), Y.n_rows, false, true);
+            CallModelH(model, x_k, y_k, 0);
+        });
+    }
+};
+
 
 #endif
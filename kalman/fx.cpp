@@ -7,6 +7,11 @@
 
 #include "fx.h"
 
+#include <algorithm>
+
+// Maximum number of step halvings of the accuracy-targeted derivatives
+#define RICHARDSON_LEVELS 8
+
 FX::FX(colvec(*f) (colvec &x, colvec &some_constants))
 {
     // Epsilon for computing the Jacobian numerically
@@ -14,6 +19,16 @@ FX::FX(colvec(*f) (colvec &x, colvec &some_constants))
 
     // Remember the callback function
     F_ = f;
+
+    // Fixed epsilon, no error estimate
+    Tolerance_ = 0;
+    ErrorEstimate_ = datum::nan;
+
+    xEps_.resize(1);
+    errEps_.resize(1);
+    xPoint_.resize(1);
+    yEps_.resize(1);
+    hEps_.resize(1);
 }
 
 FX::~FX()
@@ -28,6 +43,142 @@ colvec FX::SolveAt(colvec &x, colvec &some_constants)
 
 mat FX::JacobianAt(colvec &x, colvec &some_constants)
 {
+    return Jacobian(x, some_constants, ErrorEstimate_);
+}
+
+mat FX::HessianAt(colvec &x, colvec &some_constants, int i)
+{
+    if (Tolerance_ > 0) {
+        cube hess;
+        AdaptiveHessians(x, some_constants, hess, ErrorEstimate_, -1);
+        return hess.slice(i);
+    }
+
+    uword n = x.size();
+    mat hess;
+    hess.resize(n, n);
+
+    // Row i of the Jacobian at x + epsilon * e_j (job j) and at x - epsilon * e_j (job n + j)
+    mat jac_rows(2 * n, n);
+    pool_.ParallelFor(2 * n, [&](int k, int t) {
+        colvec &x0 = xEps_[t];
+        x0 = x;
+        if (k < (int)n)
+            x0(k) = x0(k) + Epsilon_;
+        else
+            x0(k - n) = x0(k - n) - Epsilon_;
+        jac_rows.row(k) = Jacobian(x0, some_constants, errEps_[t]).row(i);
+    });
+
+    for (uword j = 0; j < n; j++) {
+        rowvec delta = (jac_rows.row(j) - jac_rows.row(n + j)) / (2 * Epsilon_);
+        hess.row(j) = delta;
+    }
+    ErrorEstimate_ = datum::nan;
+
+    //hess.print("Hessian=");
+    return hess;
+}
+
+void FX::HessianAt(colvec &x, colvec &some_constants, cube &hess)
+{
+    if (Tolerance_ > 0) {
+        AdaptiveHessians(x, some_constants, hess, ErrorEstimate_, -1);
+        return;
+    }
+
+    colvec h(x.n_elem);
+    h.fill(Epsilon_);
+
+    mat y;
+    Stencil(x, some_constants, h, y, -1);
+    AssembleHessians(y, h, hess);
+    ErrorEstimate_ = datum::nan;
+
+    //hess.print("Hessians=");
+}
+
+void FX::JacobianAt(const mat &X, colvec &some_constants, cube &jac)
+{
+    if (X.n_cols == 0) {
+        jac.reset();
+        ErrorEstimate_ = (Tolerance_ > 0) ? 0 : datum::nan;
+        return;
+    }
+
+    std::fill(errEps_.begin(), errEps_.end(), 0.0);
+
+    // The first point gives the size of the output
+    colvec &x0 = xEps_[0];
+    x0 = X.col(0);
+    mat jac0 = Jacobian(x0, some_constants, errEps_[0]);
+
+    jac.set_size(jac0.n_rows, X.n_rows, X.n_cols);
+    jac.slice(0) = jac0;
+
+    // One point per job
+    pool_.ParallelFor(X.n_cols - 1, [&](int k, int t) {
+        colvec &x_k = xEps_[t];
+        double error;
+        x_k = X.col(k + 1);
+        jac.slice(k + 1) = Jacobian(x_k, some_constants, error);
+        errEps_[t] = std::max(errEps_[t], error);
+    });
+
+    ErrorEstimate_ = (Tolerance_ > 0) ? *std::max_element(errEps_.begin(), errEps_.end()) : datum::nan;
+}
+
+void FX::HessianAt(const mat &X, colvec &some_constants, cube &hess)
+{
+    if (X.n_cols == 0) {
+        hess.reset();
+        ErrorEstimate_ = (Tolerance_ > 0) ? 0 : datum::nan;
+        return;
+    }
+
+    int n = X.n_rows;
+    std::fill(errEps_.begin(), errEps_.end(), 0.0);
+
+    colvec h(n);
+    h.fill(Epsilon_);
+
+    // The Hessians of the k-th point go to hEps_[t]
+    auto point = [&](int k, int t) {
+        colvec &x_k = xPoint_[t];
+        x_k = X.col(k);
+
+        if (Tolerance_ > 0) {
+            double error;
+            AdaptiveHessians(x_k, some_constants, hEps_[t], error, t);
+            errEps_[t] = std::max(errEps_[t], error);
+        }
+        else {
+            Stencil(x_k, some_constants, h, yEps_[t], t);
+            AssembleHessians(yEps_[t], h, hEps_[t]);
+        }
+    };
+
+    // The first point gives the size of the output
+    point(0, 0);
+    uword m = hEps_[0].n_slices;
+
+    hess.set_size(n, n, m * X.n_cols);
+    hess.slices(0, m - 1) = hEps_[0];
+
+    // One point per job, each thread has its own stencil and Hessians
+    pool_.ParallelFor(X.n_cols - 1, [&](int k, int t) {
+        point(k + 1, t);
+        hess.slices((k + 1) * m, (k + 2) * m - 1) = hEps_[t];
+    });
+
+    ErrorEstimate_ = (Tolerance_ > 0) ? *std::max_element(errEps_.begin(), errEps_.end()) : datum::nan;
+}
+
+mat FX::Jacobian(colvec &x, colvec &some_constants, double &error)
+{
+    if (Tolerance_ > 0)
+        return AdaptiveJacobian(x, some_constants, error);
+
     colvec f0 = F_(x, some_constants);
     colvec fn;
 
@@ -45,36 +196,183 @@ mat FX::JacobianAt(colvec &x, colvec &some_constants)
             jac(i, j) = (fn(i) - f0(i)) / Epsilon_;
         }
     }
+    error = datum::nan;
 
     //jac.print("Jac=");
     return jac;
 }
 
-mat FX::HessianAt(colvec &x, colvec &some_constants, int i)
+/*!
+ * \brief Ridders' extrapolation of a central difference towards a zero step.
+ * The step is halved at each level. A plain difference is accepted as soon as
+ * its own error estimate meets the tolerance, the Richardson table is only
+ * built when it does not. Stops when the tolerance is met, when the rounding
+ * errors start to dominate, or after max_levels levels.
+ * \param diff Computes the central difference with the initial step scaled by s, diff(s, d).
+ * \param tolerance Wanted absolute error.
+ * \param max_levels Maximum number of differences.
+ * \param error Estimated absolute error of the result, this is a returned value.
+ * \return The best estimate of the derivative.
+ */
+template <class T, class Difference>
+static T Extrapolate(Difference diff, double tolerance, int max_levels, double &error)
 {
-    uword n = x.size();
-    mat hess;
-    hess.resize(n, n);
+    std::vector<T> prev(1), cur;
+    double s = 1.0;
+    diff(s, prev[0]);
 
-    for (uword j = 0; j < n; j++) {
-        colvec x0 = x;
+    T best = prev[0];
+    error = datum::inf;
 
-        x0(j) = x0(j) + Epsilon_;
-        mat hess_plus = JacobianAt(x0, some_constants);
+    for (int i = 1; i < max_levels; i++) {
+        s = s / 2;
+        cur.resize(i + 1);
+        diff(s, cur[0]);
 
-        x0 = x;
-        x0(j) = x0(j) - Epsilon_;
-        mat hess_min = JacobianAt(x0, some_constants);
+        // Halving the step divides the O(h^2) error by 4, the difference of the two is 3/4 of it
+        double e0 = abs(cur[0] - prev[0]).max() / 3;
+        if (e0 <= error) {
+            error = e0;
+            best = cur[0];
+        }
+        if (error <= tolerance)
+            break;
 
-        rowvec delta = (hess_plus.row(i) - hess_min.row(i)) / (2 * Epsilon_);
-        hess.row(j) = delta;
+        double fac = 4;
+        for (int j = 1; j <= i; j++) {
+            cur[j] = (fac * cur[j - 1] - prev[j - 1]) / (fac - 1);
+            fac = 4 * fac;
+
+            double e = std::max(abs(cur[j] - cur[j - 1]).max(), abs(cur[j] - prev[j - 1]).max());
+            if (e <= error) {
+                error = e;
+                best = cur[j];
+            }
+        }
+        if (error <= tolerance)
+            break;
+
+        // The rounding errors took over, smaller steps only make it worse.
+        // The first extrapolation has no estimate of its own yet, so skip it
+        if (i > 1 && abs(cur[i] - prev[i - 1]).max() >= 2 * error)
+            break;
+
+        prev.swap(cur);
     }
 
-    //hess.print("Hessian=");
-    return hess;
+    return best;
+}
+
+double FX::RelativeStep(colvec &x, colvec &some_constants, double min_step)
+{
+    // The central difference error is about |f| (h / |x|)^2 for a function of that scale
+    double f_scale = std::max(abs(F_(x, some_constants)).max(), 1.0);
+    return std::min(0.1, std::max(min_step, sqrt(Tolerance_ / f_scale)));
+}
+
+mat FX::AdaptiveJacobian(colvec &x, colvec &some_constants, double &error)
+{
+    // The rounding error dominates around the cube root of the machine epsilon,
+    // start well above it to leave room for the step halvings
+    double rel = RelativeStep(x, some_constants, pow(datum::eps, 0.25));
+
+    colvec x_eps = x;
+    mat jac;
+    error = 0;
+
+    for (uword j = 0; j < x.n_elem; j++) {
+        double h = rel * std::max(fabs(x(j)), 1.0);
+
+        auto diff = [&](double s, colvec &d) {
+            x_eps(j) = x(j) + s * h;
+            colvec fp = F_(x_eps, some_constants);
+            x_eps(j) = x(j) - s * h;
+            d = (fp - F_(x_eps, some_constants)) / (2 * s * h);
+            x_eps(j) = x(j);
+        };
+
+        double e;
+        colvec col = Extrapolate<colvec>(diff, Tolerance_, RICHARDSON_LEVELS, e);
+        if (j == 0)
+            jac.set_size(col.n_elem, x.n_elem);
+        jac.col(j) = col;
+        error = std::max(error, e);
+    }
+
+    return jac;
+}
+
+void FX::AdaptiveHessians(colvec &x, colvec &some_constants, cube &hess, double &error, int t)
+{
+    // Same for the second differences, whose rounding error dominates around
+    // the fourth root of the machine epsilon
+    double rel = RelativeStep(x, some_constants, pow(datum::eps, 1.0 / 6));
+
+    colvec h0(x.n_elem);
+    for (uword j = 0; j < x.n_elem; j++)
+        h0(j) = rel * std::max(fabs(x(j)), 1.0);
+
+    mat y;
+    auto diff = [&](double s, cube &d) {
+        colvec h = s * h0;
+        Stencil(x, some_constants, h, y, t);
+        AssembleHessians(y, h, d);
+    };
+
+    hess = Extrapolate<cube>(diff, Tolerance_, RICHARDSON_LEVELS, error);
+}
+
+void FX::Stencil(const colvec &x, colvec &some_constants, const colvec &h, mat &y, int t)
+{
+    int n = x.n_elem;
+    int n_points = StencilSize(n);
+
+    // The center gives the size of the function
+    colvec &x0 = xEps_[(t < 0) ? 0 : t];
+    x0 = x;
+    colvec f0 = F_(x0, some_constants);
+    y.set_size(f0.n_elem, n_points);
+    y.col(0) = f0;
+
+    if (t < 0) {
+        pool_.ParallelFor(n_points - 1, [&](int p, int s) {
+            StencilPoint(x, h, p + 1, xEps_[s]);
+            y.col(p + 1) = F_(xEps_[s], some_constants);
+        });
+    }
+    else {
+        for (int p = 1; p < n_points; p++) {
+            StencilPoint(x, h, p, x0);
+            y.col(p) = F_(x0, some_constants);
+        }
+    }
 }
 
 void FX::SetEpsilon(double epsilon)
 {
     Epsilon_ = epsilon;
 }
+
+void FX::SetTolerance(double tolerance)
+{
+    assert(tolerance >= 0 && "Whoops, the tolerance must not be negative");
+
+    Tolerance_ = tolerance;
+}
+
+double FX::GetErrorEstimate() const
+{
+    return ErrorEstimate_;
+}
+
+void FX::SetThreads(int n_threads)
+{
+    assert(n_threads > 0 && "Whoops, at least one thread is needed");
+
+    pool_.Start(n_threads);
+    xEps_.resize(n_threads);
+    errEps_.resize(n_threads);
+    xPoint_.resize(n_threads);
+    yEps_.resize(n_threads);
+    hEps_.resize(n_threads);
+}
@@ -36,6 +36,10 @@
 
 #include <assert.h>
 #include <armadillo>
+#include <vector>
+
+#include "threadpool.h"
+#include "stencil.h"
 
 using namespace std;
 using namespace arma;
@@ -70,6 +74,38 @@ public:
      * \return Hessian at location x.
      */
     mat HessianAt(colvec &x, colvec &some_constants, int i);
+
+    /*!
+     * \brief Calculate the Hessians of all elements of the vector, at certain inputs.
+     * All Hessians come from one shared stencil of n^2 + n + 1 function calls,
+     * n being the size of x.
+     * \param x Location where the Hessians are computed.
+     * \param some_constants Optional constants used in the function.
+     * \param hess Hessians, slice i belongs to the i-th element of the vector, this is a returned value.
+     */
+    void HessianAt(colvec &x, colvec &some_constants, cube &hess);
+
+    /*!
+     * \brief Calculate the Jacobians at many inputs.
+     * The inputs are spread over the thread pool, see SetThreads. An empty X
+     * gives an empty jac.
+     * \param X Locations where the Jacobians are computed, one per column.
+     * \param some_constants Optional constants used in the function.
+     * \param jac Jacobians, slice k belongs to the k-th column of X, this is a returned value.
+     */
+    void JacobianAt(const mat &X, colvec &some_constants, cube &jac);
+
+    /*!
+     * \brief Calculate the Hessians of all elements of the vector, at many inputs.
+     * The inputs are spread over the thread pool, see SetThreads. For an m-element
+     * function, the result is a 4-D array n x n x m x N stored as a cube: slice
+     * k * m + i is the Hessian of the i-th element at the k-th column of X.
+     * An empty X gives an empty hess.
+     * \param X Locations where the Hessians are computed, one per column.
+     * \param some_constants Optional constants used in the function.
+     * \param hess Hessians, this is a returned value.
+     */
+    void HessianAt(const mat &X, colvec &some_constants, cube &hess);
      
     /*!
      * \brief Solve the function at certain inputs.
@@ -80,15 +116,99 @@ public:
     colvec SolveAt(colvec &x, colvec &some_constants);
 
     /*!
-     * \brief A very small number.
+     * \brief A very small number, the step of the fixed finite differences.
      * \param epsilon A very small number.
      */
     void SetEpsilon(double epsilon);
 
+    /*!
+     * \brief Compute the derivatives to a given accuracy instead of with a fixed epsilon.
+     * The Jacobian uses central differences with one step per column, picked from
+     * the scale of x and of the function. A column whose error estimate misses the
+     * tolerance gets smaller steps and Richardson extrapolation, the others stop
+     * after two differences. The Hessians do the same on the shared stencil, with
+     * one error estimate for all of them. See GetErrorEstimate.
+     * \param tolerance Wanted absolute error of each derivative, 0 goes back to the fixed epsilon.
+     */
+    void SetTolerance(double tolerance);
+
+    /*!
+     * \brief Estimated error of the last Jacobian or Hessians.
+     * This is the largest estimated absolute error over all the derivatives
+     * computed by the last call, it can exceed the tolerance if the function is
+     * too noisy to reach it.
+     * \return The error estimate, NaN if no tolerance is set.
+     */
+    double GetErrorEstimate() const;
+
+    /*!
+     * \brief Compute the Hessians and the batches in parallel, on a persistent thread pool.
+     * The function must then be reentrant: it must not modify some_constants
+     * or any other shared data.
+     * \param n_threads Number of threads, including the calling thread, 1 disables it.
+     */
+    void SetThreads(int n_threads);
+
 private: 
+    /*!
+     * \brief Calculate the Jacobian, with the fixed epsilon or to the tolerance.
+     * \param x Location where the Jacobian is computed.
+     * \param some_constants Optional constants used in the function.
+     * \param error Estimated error, this is a returned value.
+     * \return Jacobian at location x.
+     */
+    mat Jacobian(colvec &x, colvec &some_constants, double &error);
+
+    /*!
+     * \brief Relative step of the accuracy-targeted differences.
+     * \param x Location where the derivatives are computed.
+     * \param some_constants Optional constants used in the function.
+     * \param min_step Relative step below which the rounding errors dominate.
+     * \return The step, relative to the magnitude of each element of x.
+     */
+    double RelativeStep(colvec &x, colvec &some_constants, double min_step);
+
+    /*!
+     * \brief Calculate the Jacobian to the tolerance, column by column.
+     * \param x Location where the Jacobian is computed.
+     * \param some_constants Optional constants used in the function.
+     * \param error Largest estimated error of the columns, this is a returned value.
+     * \return Jacobian at location x.
+     */
+    mat AdaptiveJacobian(colvec &x, colvec &some_constants, double &error);
+
+    /*!
+     * \brief Calculate the Hessians of all elements to the tolerance.
+     * \param x Location where the Hessians are computed.
+     * \param some_constants Optional constants used in the function.
+     * \param hess Hessians, one slice per element, this is a returned value.
+     * \param error Estimated error, this is a returned value.
+     * \param t Thread evaluating the stencil alone, -1 to spread it over the thread pool.
+     */
+    void AdaptiveHessians(colvec &x, colvec &some_constants, cube &hess, double &error, int t);
+
+    /*!
+     * \brief Evaluate the function on the shared Hessian stencil, see stencil.h.
+     * \param x Center of the stencil.
+     * \param some_constants Optional constants used in the function.
+     * \param h Step of each element of x.
+     * \param y Function values, one column per stencil point, this is a returned value.
+     * \param t Thread evaluating the stencil alone, -1 to spread it over the thread pool.
+     */
+    void Stencil(const colvec &x, colvec &some_constants, const colvec &h, mat &y, int t);
+
     colvec (*F_) (colvec &x, colvec &some_constants); ///< Remember the address of the callback function.
 
     double Epsilon_; ///< Number of the states
+    double Tolerance_;      ///< Wanted error of the derivatives, 0 for the fixed epsilon
+    double ErrorEstimate_;  ///< Estimated error of the last derivatives
+
+    ThreadPool pool_;             ///< Workers for the parallel Hessians and batches
+    std::vector<colvec> xEps_;    ///< Perturbed inputs, one per thread
+    std::vector<double> errEps_;  ///< Largest error estimate of a batch, one per thread
+    std::vector<colvec> xPoint_;  ///< Current input of a batch, one per thread
+    std::vector<mat> yEps_;       ///< Function values on a stencil, one per thread
+    std::vector<cube> hEps_;      ///< Hessians of one input of a batch, one per thread
 };
 
 #endif
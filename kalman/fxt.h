@@ -0,0 +1,184 @@
+/**
+ * @file fxt.h
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief A header file for a user defined mathematical function, given as any callable.
+ *
+ * @section DESCRIPTION
+ * Same derivatives as FX, but the function can be anything callable: a function,
+ * a functor or a lambda with captured state, which the compiler can inline.
+ * Two signatures are accepted:
+ * \code
+ * colvec f(const colvec &x, const colvec &some_constants);              // returns the result
+ * void f(const colvec &x, const colvec &some_constants, colvec &out);   // writes into out
+ * \endcode
+ * With the second one, nothing is allocated once the buffers have their size:
+ * x is perturbed in place in a scratch vector and all results go into buffers
+ * kept by the object. Example:
+ * \code
+ * double a = 2.0;
+ * auto foo = [a](const colvec &x, const colvec &c, colvec &out) {
+ *     out.set_size(1);
+ *     out(0) = a * x(0) * x(1) * x(2);
+ * };
+ * FXT<decltype(foo)> f(foo);  // or: auto f = MakeFXT(foo);
+ * f.JacobianAt(x, c, jac);
+ * \endcode
+ */
+
+#ifndef FXT_H
+#define FXT_H
+
+#define ARMA_USE_LAPACK // This definition must be before the include to the armadillo
+
+
+#define _USE_MATH_DEFINES
+
+#include <math.h>
+
+#include <assert.h>
+#include <armadillo>
+
+#include "model_call.h"
+#include "stencil.h"
+
+using namespace std;
+using namespace arma;
+
+template <class Function>
+class FXT
+{
+public:
+    /*!
+     * \brief Constructor, create a mathematical function.
+     * \param f The callable, it is copied.
+     */
+    FXT(const Function &f) : F_(f), Epsilon_(1e-5)
+    {
+    }
+
+    /*!
+     * \brief Solve the function at certain inputs.
+     * \param x Location where the function is solved.
+     * \param some_constants Optional constants used in the function.
+     * \param y Result from solving the function, this is a returned value.
+     */
+    void SolveAt(const colvec &x, const colvec &some_constants, colvec &y)
+    {
+        CallFunction(F_, x, some_constants, y, 0);
+    }
+
+    /*!
+     * \brief Calculate the Jacobian at certain inputs, with forward differences.
+     * \param x Location where the Jacobian is computed.
+     * \param some_constants Optional constants used in the function.
+     * \param jac Jacobian at location x, this is a returned value.
+     */
+    void JacobianAt(const colvec &x, const colvec &some_constants, mat &jac)
+    {
+        CallFunction(F_, x, some_constants, f0_, 0);
+        jac.set_size(f0_.n_elem, x.n_elem);
+
+        // Perturb one element at a time, in place
+        xEps_ = x;
+        for (uword j = 0; j < x.n_elem; j++) {
+            xEps_(j) = x(j) + Epsilon_;
+            CallFunction(F_, xEps_, some_constants, fn_, 0);
+            xEps_(j) = x(j);
+
+            for (uword i = 0; i < f0_.n_elem; i++)
+                jac(i, j) = (fn_(i) - f0_(i)) / Epsilon_;
+        }
+    }
+
+    /*!
+     * \brief Calculate the Hessian, at certain inputs.
+     * Central differences of forward-difference Jacobians, like FX::HessianAt.
+     * \param x Location where the Hessian is computed.
+     * \param some_constants Optional constants used in the function.
+     * \param i For a function of vector, do Hessian at i-th element of the vector.
+     * \param hess Hessian at location x, this is a returned value.
+     */
+    void HessianAt(const colvec &x, const colvec &some_constants, int i, mat &hess)
+    {
+        uword n = x.n_elem;
+        hess.set_size(n, n);
+
+        xH_ = x;
+        for (uword j = 0; j < n; j++) {
+            xH_(j) = x(j) + Epsilon_;
+            JacobianAt(xH_, some_constants, jacPlus_);
+
+            xH_(j) = x(j) - Epsilon_;
+            JacobianAt(xH_, some_constants, jacMinus_);
+            xH_(j) = x(j);
+
+            for (uword k = 0; k < n; k++)
+                hess(j, k) = (jacPlus_(i, k) - jacMinus_(i, k)) / (2 * Epsilon_);
+        }
+    }
+
+    /*!
+     * \brief Calculate the Hessians of all elements of the vector, at certain inputs.
+     * All Hessians come from one shared stencil of n^2 + n + 1 function calls,
+     * like FX::HessianAt.
+     * \param x Location where the Hessians are computed.
+     * \param some_constants Optional constants used in the function.
+     * \param hess Hessians, slice i belongs to the i-th element of the vector, this is a returned value.
+     */
+    void HessianAt(const colvec &x, const colvec &some_constants, cube &hess)
+    {
+        int n = x.n_elem;
+        int n_points = StencilSize(n);
+        hStep_.set_size(n);
+        hStep_.fill(Epsilon_);
+
+        // The center gives the size of the function
+        CallFunction(F_, x, some_constants, f0_, 0);
+        y_.set_size(f0_.n_elem, n_points);
+        y_.col(0) = f0_;
+
+        for (int p = 1; p < n_points; p++) {
+            StencilPoint(x, hStep_, p, xEps_);
+            CallFunction(F_, xEps_, some_constants, fn_, 0);
+            y_.col(p) = fn_;
+        }
+
+        AssembleHessians(y_, hStep_, hess);
+    }
+
+    /*!
+     * \brief A very small number.
+     * \param epsilon A very small number.
+     */
+    void SetEpsilon(double epsilon)
+    {
+        Epsilon_ = epsilon;
+    }
+
+private:
+    Function F_;        ///< The user defined function
+    double Epsilon_;    ///< Finite-difference perturbation
+
+    colvec xEps_;       ///< Perturbed input, scratch of the Jacobian and the Hessian stencil
+    colvec xH_;         ///< Perturbed input, scratch of the Jacobian-of-Jacobian Hessian
+    colvec f0_;         ///< f at the unperturbed input
+    colvec fn_;         ///< f at a perturbed input
+    colvec hStep_;      ///< Step of each element of x on the Hessian stencil
+    mat y_;             ///< f on the Hessian stencil, one column per point
+    mat jacPlus_;       ///< Jacobian at x + epsilon * e_j
+    mat jacMinus_;      ///< Jacobian at x - epsilon * e_j
+};
+
+/*!
+ * \brief Create an FXT without spelling out the type of the callable.
+ * \param f The callable.
+ * \return The mathematical function.
+ */
+template <class Function>
+FXT<Function> MakeFXT(const Function &f)
+{
+    return FXT<Function>(f);
+}
+
+#endif
@@ -0,0 +1,177 @@
+/**
+ * @file innovation.cpp
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Cholesky factor of an innovation covariance.
+ */
+
+#include <limits>
+
+#include "innovation.h"
+
+template <class eT>
+InnovationFactor<eT>::InnovationFactor()
+{
+    loading_ = 0;
+    nis_ = 0;
+    logLik_ = 0;
+}
+
+template <class eT>
+void InnovationFactor<eT>::SetSize(int n_states, int n_outputs)
+{
+    L_.zeros(n_outputs, n_outputs);
+    W_.set_size(n_states, n_outputs);
+    y_.set_size(n_outputs);
+}
+
+template <class eT>
+bool InnovationFactor<eT>::Cholesky(const mat& S, double shift)
+{
+    uword m = S.n_rows;
+
+    for (uword j = 0; j < m; j++) {
+        double d = S(j, j) + shift;
+        for (uword k = 0; k < j; k++)
+            d = d - L_(j, k) * L_(j, k);
+
+        // Also stops at a NaN
+        if (!(d > 0))
+            return false;
+
+        L_(j, j) = sqrt(d);
+        for (uword i = j + 1; i < m; i++) {
+            double sum = S(i, j);
+            for (uword k = 0; k < j; k++)
+                sum = sum - L_(i, k) * L_(j, k);
+            L_(i, j) = sum / L_(j, j);
+        }
+    }
+
+    return true;
+}
+
+template <class eT>
+bool InnovationFactor<eT>::Factor(const mat& S)
+{
+    arma_assert_same_size(S.n_rows, S.n_cols, L_.n_rows, L_.n_cols, "Whoops, S has the wrong size");
+
+    loading_ = 0;
+    if (Cholesky(S, 0))
+        return true;
+
+    // S is not numerically positive definite, S + shift * I is factored instead.
+    // The shift starts small relative to the scale of S and doubles until the
+    // factorization goes through, which it does once the shift is larger than
+    // the magnitude of the most negative eigenvalue. It is then doubled once
+    // more, so the smallest eigenvalue of the shifted S is not close to zero
+    double scale = 0;
+    for (uword j = 0; j < S.n_rows; j++)
+        scale = scale + fabs((double)S(j, j));
+    scale = max(scale / S.n_rows, (double)std::numeric_limits<eT>::min());
+
+    for (double shift = sqrt((double)std::numeric_limits<eT>::epsilon()) * scale;
+        shift <= std::numeric_limits<eT>::max(); shift = 2 * shift) {
+        if (Cholesky(S, shift)) {
+            loading_ = 2 * shift;
+            Cholesky(S, loading_);
+            return false;
+        }
+    }
+
+    // Only a S that is not finite gets here, nothing sensible can come out of it
+    loading_ = datum::inf;
+    L_.fill(datum::nan);
+    return false;
+}
+
+template <class eT>
+void InnovationFactor<eT>::SetFactor(const mat& L)
+{
+    arma_assert_same_size(L.n_rows, L.n_cols, L_.n_rows, L_.n_cols, "Whoops, L has the wrong size");
+
+    L_ = L;
+    loading_ = 0;
+}
+
+template <class eT>
+void InnovationFactor<eT>::Gain(const mat& PHt, mat& K)
+{
+    // W L' = PHt, then K L = W
+    SmallMat::SolveLowerTrans(L_, PHt, W_);
+    SmallMat::SolveLower(L_, W_, K);
+}
+
+template <class eT>
+void InnovationFactor<eT>::Downdate(mat& P)
+{
+    uword n = W_.n_rows;
+    uword m = W_.n_cols;
+
+    // The lower triangle is updated and mirrored, so P leaves exactly symmetric
+    // even if it came in with the two triangles differing by rounding
+    for (uword j = 0; j < n; j++) {
+        for (uword i = j; i < n; i++) {
+            double sum = 0;
+            for (uword k = 0; k < m; k++)
+                sum = sum + W_(i, k) * W_(j, k);
+            P(i, j) = P(i, j) - sum;
+            P(j, i) = P(i, j);
+        }
+    }
+}
+
+template <class eT>
+double InnovationFactor<eT>::Evaluate(const colvec& innov)
+{
+    uword m = L_.n_rows;
+
+    // y = L^-1 innov, then innov' S^-1 innov = y' y
+    double log_det = 0;
+    nis_ = 0;
+    for (uword i = 0; i < m; i++) {
+        double sum = innov(i);
+        for (uword j = 0; j < i; j++)
+            sum = sum - L_(i, j) * y_(j);
+        y_(i) = sum / L_(i, i);
+
+        nis_ = nis_ + (double)y_(i) * y_(i);
+        log_det = log_det + 2 * log((double)L_(i, i));
+    }
+
+    logLik_ = -0.5 * (nis_ + log_det + m * log(2 * M_PI));
+    return nis_;
+}
+
+template <class eT>
+const typename InnovationFactor<eT>::mat& InnovationFactor<eT>::GetScaledGain() const
+{
+    return W_;
+}
+
+template <class eT>
+const typename InnovationFactor<eT>::mat& InnovationFactor<eT>::GetFactor() const
+{
+    return L_;
+}
+
+template <class eT>
+double InnovationFactor<eT>::GetLoading() const
+{
+    return loading_;
+}
+
+template <class eT>
+double InnovationFactor<eT>::GetNIS() const
+{
+    return nis_;
+}
+
+template <class eT>
+double InnovationFactor<eT>::GetLogLikelihood() const
+{
+    return logLik_;
+}
+
+template class InnovationFactor<float>;
+template class InnovationFactor<double>;
@@ -0,0 +1,154 @@
+/**
+ * @file innovation.h
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Header file for the Cholesky factor of an innovation covariance.
+ *
+ * @section DESCRIPTION
+ * The measurement update of all the filters needs S^-1, S being the
+ * innovation covariance, symmetric and positive definite. Instead of
+ * inverting S, it is factored once, S = L L', and the factor is used for
+ * everything that needs S^-1:
+ * - the gain, K = PHt S^-1, by triangular substitutions,
+ * - the covariance update, P - K S K' = P - W W' with W = PHt L^-T = K L,
+ * - the normalized innovation squared, y' S^-1 y = |L^-1 y|^2,
+ * - the log-likelihood of the innovation, with log det S = 2 sum log L_ii.
+ *
+ * When S is not numerically positive definite, it is regularized: the
+ * factor of S + shift * I is computed instead, the shift being found by
+ * doubling, see Factor and GetLoading.
+ * Everything is computed in place, nothing is allocated once the sizes are set.
+ */
+
+#ifndef INNOVATION_H
+#define INNOVATION_H
+
+#define ARMA_USE_LAPACK // This definition must be before the include to the armadillo
+
+
+#define _USE_MATH_DEFINES
+
+#include <math.h>
+
+#include <assert.h>
+#include <armadillo>
+
+#include "smallmat.h"
+
+using namespace std;
+using namespace arma;
+
+/*!
+ * @brief Cholesky factor of an innovation covariance, and what is computed from it.
+ * The element type eT is float or double.
+ */
+template <class eT>
+class InnovationFactor {
+public:
+    typedef Mat<eT> mat;      ///< Matrix of the element type
+    typedef Col<eT> colvec;   ///< Column vector of the element type
+
+    /*!
+     * \brief Constructor, nothing happens here.
+     */
+    InnovationFactor();
+
+    /*!
+     * \brief Size the workspace.
+     * @param n_states Number of the states, rows of the gain
+     * @param n_outputs Number of the outputs, size of S
+     */
+    void SetSize(int n_states, int n_outputs);
+
+    /*!
+     * \brief Factor S = L L'.
+     * Only the lower triangle of S is read. If S is not numerically positive
+     * definite, S + shift * I is factored instead. The shift starts at
+     * sqrt(epsilon) times the mean diagonal of S and is doubled until the
+     * factorization goes through, then once more so the shifted S is not
+     * nearly singular. The sign of a pivot is never changed.
+     * If S is not finite, it cannot be factored: L is NaN and the loading infinite.
+     * @param S Innovation covariance
+     * @return True if S is positive definite, false if it had to be shifted or could not be factored
+     */
+    bool Factor(const mat& S);
+
+    /*!
+     * \brief Use a lower Cholesky factor that is already known, as in the square-root filters.
+     * @param L Lower triangular factor of S, with a positive diagonal
+     */
+    void SetFactor(const mat& L);
+
+    /*!
+     * \brief Kalman gain K = PHt S^-1, with a forward and a back substitution, see SmallMat.
+     * W = PHt L^-T is kept for Downdate.
+     * @param PHt Cross covariance of the state and the output, P H' for the linearized filters
+     * @param K Kalman gain, this is a returned value
+     */
+    void Gain(const mat& PHt, mat& K);
+
+    /*!
+     * \brief Covariance update, P = P - K S K' = P - W W'.
+     * Must follow Gain. Only the lower triangle of P is read, the upper one
+     * is written as its mirror, so the rounding cannot make P drift away from symmetric.
+     * @param P State covariance, updated in place
+     */
+    void Downdate(mat& P);
+
+    /*!
+     * \brief Normalized innovation squared and log-likelihood of an innovation.
+     * @param innov Innovation, the measurement minus the predicted output
+     * @return The normalized innovation squared, innov' S^-1 innov
+     */
+    double Evaluate(const colvec& innov);
+
+    /*!
+     * \brief K L, the gain scaled by the factor, computed by Gain.
+     * Its columns are the downdates of the square-root covariance.
+     * @return W
+     */
+    const mat& GetScaledGain() const;
+
+    /*!
+     * \brief Lower Cholesky factor of the (loaded) innovation covariance.
+     * @return L
+     */
+    const mat& GetFactor() const;
+
+    /*!
+     * \brief The shift added to the diagonal of S to factor it.
+     * @return The loading of the last factorization, 0 if S was positive definite,
+     * infinite if S could not be factored
+     */
+    double GetLoading() const;
+
+    /*!
+     * \brief Normalized innovation squared of the last evaluated innovation.
+     * @return innov' S^-1 innov
+     */
+    double GetNIS() const;
+
+    /*!
+     * \brief Log-likelihood of the last evaluated innovation, under N(0, S).
+     * @return -(innov' S^-1 innov + log det S + m log 2 pi) / 2
+     */
+    double GetLogLikelihood() const;
+
+private:
+    /*!
+     * \brief Cholesky factorization of S + shift * I into L_.
+     * @param S Innovation covariance
+     * @param shift Added to the diagonal of S
+     * @return False if a pivot is not positive, L_ is then incomplete
+     */
+    bool Cholesky(const mat& S, double shift);
+
+    mat L_;           ///< Lower Cholesky factor of S
+    mat W_;           ///< PHt L^-T, that is K L
+    colvec y_;        ///< L^-1 innov, the whitened innovation
+    double loading_;  ///< Shift added to the diagonal of S
+    double nis_;      ///< Normalized innovation squared
+    double logLik_;   ///< Log-likelihood of the innovation
+};
+
+#endif
@@ -0,0 +1,233 @@
+/**
+ * @file jtable.cpp
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief A precomputed Jacobian lookup table.
+ */
+
+#include <cmath>
+#include <fstream>
+#include <stdint.h>
+#include <string.h>
+
+#include "jtable.h"
+
+// Interpolating visits 2^d corners, keep d small
+#define JTABLE_MAX_DIMS 8
+
+// Identifies the binary file, followed by the format version
+static const char JTABLE_MAGIC[4] = { 'K', 'J', 'T', '1' };
+
+JacobianTable::JacobianTable()
+{
+    nRows_ = 0;
+    nCols_ = 0;
+}
+
+JacobianTable::~JacobianTable()
+{
+
+}
+
+void JacobianTable::InitGrid(const uvec& components, const colvec& lower, const colvec& upper,
+    const uvec& n_points, int n_rows, int n_cols)
+{
+    assert(components.n_elem > 0 && components.n_elem <= JTABLE_MAX_DIMS &&
+        "Whoops, between 1 and 8 scheduling components are supported");
+    assert(lower.n_elem == components.n_elem && upper.n_elem == components.n_elem &&
+        n_points.n_elem == components.n_elem && "Whoops, one bound and one grid size per component");
+    assert(all(n_points >= 2) && "Whoops, at least two grid points are needed per component");
+    assert(all(upper > lower) && "Whoops, upper bounds must be larger than lower bounds");
+
+    components_ = components;
+    lower_ = lower;
+    upper_ = upper;
+    nPoints_ = n_points;
+    nRows_ = n_rows;
+    nCols_ = n_cols;
+
+    // The first scheduling component runs fastest
+    strides_.set_size(components.n_elem);
+    uword n_nodes = 1;
+    for (uword a = 0; a < components.n_elem; a++) {
+        strides_(a) = n_nodes;
+        n_nodes = n_nodes * n_points(a);
+    }
+
+    data_.zeros(n_rows * n_cols, n_nodes);
+}
+
+int JacobianTable::GetNumberOfNodes() const
+{
+    return (int)data_.n_cols;
+}
+
+bool JacobianTable::Fits(int n_rows, int n_states) const
+{
+    return nRows_ == n_rows && nCols_ == n_states && components_.n_elem > 0 &&
+        all(components_ < (uword)n_states);
+}
+
+template <class eT>
+Col<eT> JacobianTable::GetNode(int k, const Col<eT>& x_nominal) const
+{
+    Col<eT> x = x_nominal;
+
+    for (uword a = 0; a < components_.n_elem; a++) {
+        uword i = (k / strides_(a)) % nPoints_(a);
+        x(components_(a)) = lower_(a) + (upper_(a) - lower_(a)) * i / (nPoints_(a) - 1);
+    }
+
+    return x;
+}
+
+template <class eT>
+void JacobianTable::SetNode(int k, const Mat<eT>& J)
+{
+    arma_assert_same_size(J.n_rows, J.n_cols, (uword)nRows_, (uword)nCols_, "Whoops, wrong size of the Jacobian");
+    data_.col(k) = conv_to<colvec>::from(vectorise(J));
+}
+
+void JacobianTable::Tabulate(FX& fx, const colvec& x_nominal, colvec& some_constants)
+{
+    for (int k = 0; k < GetNumberOfNodes(); k++) {
+        colvec x = GetNode(k, x_nominal);
+        SetNode(k, fx.JacobianAt(x, some_constants));
+    }
+}
+
+template <class eT>
+void JacobianTable::Lookup(const Col<eT>& x, Mat<eT>& J) const
+{
+    uword d = components_.n_elem;
+    uword base = 0;
+    double frac[JTABLE_MAX_DIMS];
+
+    // Find the cell and the position inside the cell, per scheduling component
+    for (uword a = 0; a < d; a++) {
+        double t = (x(components_(a)) - lower_(a)) / (upper_(a) - lower_(a)) * (nPoints_(a) - 1);
+        if (std::isnan(t)) {
+            // No cell for it, and casting it to an index is undefined
+            J.set_size(nRows_, nCols_);
+            J.fill(datum::nan);
+            return;
+        }
+        t = (t < 0) ? 0 : t;
+        t = (t > nPoints_(a) - 1) ? nPoints_(a) - 1 : t;
+
+        uword i = (uword)floor(t);
+        i = (i > nPoints_(a) - 2) ? nPoints_(a) - 2 : i;
+
+        frac[a] = t - i;
+        base = base + i * strides_(a);
+    }
+
+    J.zeros(nRows_, nCols_);
+    eT* out = J.memptr();
+    uword n_elem = J.n_elem;
+
+    // Multilinear interpolation, visit the 2^d corners of the cell
+    for (uword corner = 0; corner < (1u << d); corner++) {
+        uword node = base;
+        double w = 1;
+        for (uword a = 0; a < d; a++) {
+            if (corner & (1u << a)) {
+                node = node + strides_(a);
+                w = w * frac[a];
+            }
+            else {
+                w = w * (1 - frac[a]);
+            }
+        }
+
+        if (w == 0)
+            continue;
+
+        const double* src = data_.colptr(node);
+        for (uword e = 0; e < n_elem; e++)
+            out[e] = out[e] + (eT)(w * src[e]);
+    }
+}
+
+template colvec JacobianTable::GetNode(int k, const colvec& x_nominal) const;
+template fcolvec JacobianTable::GetNode(int k, const fcolvec& x_nominal) const;
+template void JacobianTable::SetNode(int k, const mat& J);
+template void JacobianTable::SetNode(int k, const fmat& J);
+template void JacobianTable::Lookup(const colvec& x, mat& J) const;
+template void JacobianTable::Lookup(const fcolvec& x, fmat& J) const;
+
+bool JacobianTable::Save(const string& file_name) const
+{
+    ofstream file(file_name.c_str(), ios::binary);
+    if (!file.is_open())
+        return false;
+
+    int32_t header[3] = { (int32_t)components_.n_elem, nRows_, nCols_ };
+    file.write(JTABLE_MAGIC, sizeof(JTABLE_MAGIC));
+    file.write((const char*)header, sizeof(header));
+
+    for (uword a = 0; a < components_.n_elem; a++) {
+        uint32_t index = (uint32_t)components_(a);
+        uint32_t n = (uint32_t)nPoints_(a);
+        file.write((const char*)&index, sizeof(index));
+        file.write((const char*)&n, sizeof(n));
+        file.write((const char*)&lower_(a), sizeof(double));
+        file.write((const char*)&upper_(a), sizeof(double));
+    }
+
+    file.write((const char*)data_.memptr(), data_.n_elem * sizeof(double));
+    return file.good();
+}
+
+bool JacobianTable::Load(const string& file_name)
+{
+    ifstream file(file_name.c_str(), ios::binary);
+    if (!file.is_open())
+        return false;
+
+    char magic[4];
+    int32_t header[3];
+    file.read(magic, sizeof(magic));
+    file.read((char*)header, sizeof(header));
+    if (!file.good() || memcmp(magic, JTABLE_MAGIC, sizeof(magic)) != 0)
+        return false;
+    if (header[0] < 1 || header[0] > JTABLE_MAX_DIMS || header[1] < 1 || header[2] < 1)
+        return false;
+
+    uword d = header[0];
+    uword n_elem = (uword)header[1] * (uword)header[2];
+    uvec components(d), n_points(d);
+    colvec lower(d), upper(d);
+    for (uword a = 0; a < d; a++) {
+        uint32_t index, n;
+        file.read((char*)&index, sizeof(index));
+        file.read((char*)&n, sizeof(n));
+        file.read((char*)&lower(a), sizeof(double));
+        file.read((char*)&upper(a), sizeof(double));
+        components(a) = index;
+        n_points(a) = n;
+    }
+    if (!file.good() || any(n_points < 2) || any(components >= (uword)header[2]) ||
+        !lower.is_finite() || !upper.is_finite() || any(upper <= lower))
+        return false;
+
+    // The rest of the file must hold exactly the Jacobians of all the nodes
+    streamoff start = file.tellg();
+    file.seekg(0, ios::end);
+    streamoff n_bytes = file.tellg() - start;
+    file.seekg(start);
+    double n_nodes = 1;
+    for (uword a = 0; a < d; a++)
+        n_nodes = n_nodes * n_points(a);
+    if (n_nodes * n_elem * sizeof(double) != (double)n_bytes)
+        return false;
+
+    mat data(n_elem, (uword)n_nodes);
+    file.read((char*)data.memptr(), data.n_elem * sizeof(double));
+    if (!file.good())
+        return false;
+
+    InitGrid(components, lower, upper, n_points, header[1], header[2]);
+    data_ = data;
+    return true;
+}
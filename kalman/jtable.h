@@ -0,0 +1,144 @@
+/**
+ * @file jtable.h
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Header file for a precomputed Jacobian lookup table.
+ *
+ * @section DESCRIPTION
+ * For gain-scheduled models, the Jacobian only depends on a few state
+ * components (for example speed and steering angle) that stay inside a
+ * bounded operating envelope. The Jacobian is then tabulated offline on a
+ * regular grid over these components and interpolated (multilinear) at
+ * runtime, which replaces the n+1 model evaluations per step by a table read.
+ * The other state components are taken from a nominal state while tabulating.
+ */
+
+#ifndef JTABLE_H
+#define JTABLE_H
+
+#define ARMA_USE_LAPACK // This definition must be before the include to the armadillo
+
+
+#define _USE_MATH_DEFINES
+
+#include <math.h>
+
+#include <assert.h>
+#include <armadillo>
+#include <string>
+
+#include "fx.h"
+
+using namespace std;
+using namespace arma;
+
+/*!
+ * @brief A table of Jacobians over a regular grid of some state components.
+ */
+class JacobianTable {
+public:
+    /*!
+     * \brief Constructor, nothing happens here.
+     */
+    JacobianTable();
+
+    /*!
+     * \brief Destructor, nothing happens here.
+     */
+    ~JacobianTable();
+
+    /*!
+     * \brief Define the grid and the size of the tabulated Jacobians.
+     * @param components Indices of the scheduling state components
+     * @param lower Lower bound of the envelope, one per scheduling component
+     * @param upper Upper bound of the envelope, one per scheduling component
+     * @param n_points Number of grid points, at least 2, one per scheduling component
+     * @param n_rows Number of rows of the Jacobian
+     * @param n_cols Number of columns of the Jacobian, this is the number of the states
+     */
+    void InitGrid(const uvec& components, const colvec& lower, const colvec& upper,
+        const uvec& n_points, int n_rows, int n_cols);
+
+    /*!
+     * \brief Total number of grid nodes.
+     * @return Number of nodes
+     */
+    int GetNumberOfNodes() const;
+
+    /*!
+     * \brief Check that the table can stand for a Jacobian of a filter.
+     * @param n_rows Number of rows of the Jacobian
+     * @param n_states Number of the states, this is the number of columns of the Jacobian
+     * @return True if the Jacobians have this size and the scheduling components are states
+     */
+    bool Fits(int n_rows, int n_states) const;
+
+    /*!
+     * \brief Get the state at a grid node.
+     * The element type is float or double, like the filters.
+     * @param k Index of the node
+     * @param x_nominal Nominal state, gives the non-scheduling components
+     * @return x_nominal, with the scheduling components set to the node
+     */
+    template <class eT>
+    Col<eT> GetNode(int k, const Col<eT>& x_nominal) const;
+
+    /*!
+     * \brief Store the Jacobian of a grid node.
+     * The table itself is kept in double precision.
+     * @param k Index of the node
+     * @param J Jacobian at the node
+     */
+    template <class eT>
+    void SetNode(int k, const Mat<eT>& J);
+
+    /*!
+     * \brief Fill the whole table with the numerical Jacobian of a function.
+     * @param fx The function
+     * @param x_nominal Nominal state, gives the non-scheduling components
+     * @param some_constants Optional constants used in the function
+     */
+    void Tabulate(FX& fx, const colvec& x_nominal, colvec& some_constants);
+
+    /*!
+     * \brief Interpolate the Jacobian at a state.
+     * Outside of the envelope, the table is clamped to its border.
+     * A scheduling component that is NaN gives a Jacobian of NaN.
+     * The element type is float or double, like the filters.
+     * @param x The state, only the scheduling components are used
+     * @param J The interpolated Jacobian, this is a returned value
+     */
+    template <class eT>
+    void Lookup(const Col<eT>& x, Mat<eT>& J) const;
+
+    /*!
+     * \brief Write the table into a binary file.
+     * @param file_name Name of the file
+     * @return True on success
+     */
+    bool Save(const string& file_name) const;
+
+    /*!
+     * \brief Read the table from a binary file written by Save.
+     * The header is checked against the size of the file before anything is
+     * allocated, and the table is left as it was if the file is not valid.
+     * Use Fits to check the table against the filter.
+     * @param file_name Name of the file
+     * @return True on success
+     */
+    bool Load(const string& file_name);
+
+private:
+    uvec components_;   ///< Indices of the scheduling state components
+    colvec lower_;      ///< Lower bound of the envelope
+    colvec upper_;      ///< Upper bound of the envelope
+    uvec nPoints_;      ///< Number of grid points per scheduling component
+    uvec strides_;      ///< Distance between two neighbouring nodes, per scheduling component
+
+    int nRows_;         ///< Number of rows of the Jacobian
+    int nCols_;         ///< Number of columns of the Jacobian
+
+    mat data_;          ///< One column per node, holding the Jacobian column by column
+};
+
+#endif
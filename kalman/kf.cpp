@@ -7,17 +7,20 @@
 
 #include "kf.h"
 
-KF::KF()
+template <class eT>
+BasicKF<eT>::BasicKF()
 {
-
+  noiseGenerator_ = 0;
 }
 
-KF::~KF()
+template <class eT>
+BasicKF<eT>::~BasicKF()
 {
   
 }
 
-void KF::InitSystem(const mat& A, const mat& B, const mat& H, const mat& Q, const mat& R)
+template <class eT>
+void BasicKF<eT>::InitSystem(const mat& A, const mat& B, const mat& H, const mat& Q, const mat& R)
 {
   A_ = A;
   B_ = B;
@@ -25,9 +28,9 @@ void KF::InitSystem(const mat& A, const mat& B, const mat& H, const mat& Q, cons
   Q_ = Q;
   R_ = R;
     
-  // Stdev is sqrt of variance
-  sqrt_Q_ = sqrt(Q_);
-  sqrt_R_ = sqrt(R_);
+  // Cholesky factors of the noise covariances, the simulation draws unit noise through them
+  NoiseGenerator::CovarianceFactor(Q_, sqrt_Q_);
+  NoiseGenerator::CovarianceFactor(R_, sqrt_R_);
         
   int n_states = A.n_cols;
   int n_outputs = H.n_rows;
@@ -53,79 +56,138 @@ void KF::InitSystem(const mat& A, const mat& B, const mat& H, const mat& Q, cons
   // Inital values:
   P_m_ = P_m_.eye();
   x_m_ = x_m_.zeros();
+
+  // Workspace, the steps only write into these
+  At_ = trans(A_);
+  Ht_ = trans(H_);
+  AP_.set_size(n_states, n_states);
+  PHt_.set_size(n_states, n_outputs);
+  S_.set_size(n_outputs, n_outputs);
+  factor_.SetSize(n_states, n_outputs);
+  K_.set_size(n_states, n_outputs);
+  innov_.set_size(n_outputs);
+  xw_.set_size(n_states);
+  x_.set_size(n_states);
+  z_.set_size(n_outputs);
+  z_m_.set_size(n_outputs);
 }
 
-void KF::InitSystemState(const colvec& x0)
+template <class eT>
+void BasicKF<eT>::InitSystemState(const colvec& x0)
 {
   arma_assert_same_size(x_.n_rows, x_.n_cols, x0.n_rows, x0.n_cols, "Whoops, error initializing system states");
   x_ = x0;
   x_m_ = x0;
 }
 
-void KF::InitStateCovariance(const mat& P0)
+template <class eT>
+void BasicKF<eT>::InitStateCovariance(const mat& P0)
 {
   arma_assert_same_size(P_m_.n_rows, P_m_.n_cols, P0.n_rows, P0.n_cols, "Whoops, error initializing state covariance");
   P_m_ = P0;
 }
   
-void KF::Kalmanf(const colvec& u)
+template <class eT>
+void BasicKF<eT>::Kalmanf(const colvec& u)
 {
   // Simulate true system, with noise
-  // randn uses a normal/Gaussian distribution with zero mean and unit variance
-  v_.randn(A_.n_rows);
-  w_.randn(H_.n_rows);
-  v_ = sqrt_Q_ * v_;
-  w_ = sqrt_R_ * w_;
-  x_ = A_ * x_ + B_ * u + v_;
-  z_ = H_ * x_ + w_;
-  
-  // Prior update:
-  x_p_ = A_ * x_m_ + B_ * u;
-  P_p_ = A_ * P_m_ * trans(A_) + Q_;
+  // Unit Gaussian noise from the generator of the filter
+  GetNoiseGenerator()->Gaussian(v_);
+  GetNoiseGenerator()->Gaussian(w_);
+  xw_ = sqrt_Q_ * v_;
+  xw_ += A_ * x_;
+  xw_ += B_ * u;
+  x_ = xw_;
+  z_ = H_ * x_;
+  z_ += sqrt_R_ * w_;
   
-  // Measurement update:
-  mat K = P_p_ * trans(H_) * inv(H_ * P_p_ * trans(H_) + R_);
-  x_m_ = x_p_ + K * (z_ - H_ * x_p_);
-  P_m_ = P_p_ - K * H_ * P_p_;
-  
-  // Estimated output is the projection of etimated states to the output function
-  z_m_ = H_ * x_m_;
+  Update(z_, u);
 }
 
-void KF::Kalmanf(const colvec& z, const colvec& u)
+template <class eT>
+void BasicKF<eT>::Kalmanf(const colvec& z, const colvec& u)
 {
-  // Prior update:
-  x_p_ = A_ * x_m_ + B_ * u;
-  P_p_ = A_ * P_m_ * trans(A_) + Q_;
+  Update(z, u);
+}
+
+template <class eT>
+void BasicKF<eT>::Update(const colvec& z, const colvec& u)
+{
+  // Prior update, P_p = A * P_m * A' + Q
+  x_p_ = A_ * x_m_;
+  x_p_ += B_ * u;
+  SmallMat::Sandwich(A_, P_m_, At_, AP_, P_p_);
+  P_p_ += Q_;
+  
+  // Measurement update, K = P_p * H' * S^-1 with S = H * P_p * H' + R,
+  // from the Cholesky factor of S
+  SmallMat::Multiply(P_p_, Ht_, PHt_);
+  SmallMat::Multiply(H_, PHt_, S_);
+  S_ += R_;
+  factor_.Factor(S_);
+  factor_.Gain(PHt_, K_);
+  
+  innov_ = z;
+  innov_ -= H_ * x_p_;
+  factor_.Evaluate(innov_);
+  x_m_ = x_p_;
+  x_m_ += K_ * innov_;
   
-  // Measurement update:
-  mat K = P_p_ * trans(H_) * inv(H_ * P_p_ * trans(H_) + R_);
-  x_m_ = x_p_ + K * (z - H_ * x_p_);
-  P_m_ = P_p_ - K * H_ * P_p_;
+  // P_m = P_p - K * S * K'
+  P_m_ = P_p_;
+  factor_.Downdate(P_m_);
   
   // Estimated output is the projection of etimated states to the output function
   z_m_ = H_ * x_m_;
 }
 
-colvec* KF::GetCurrentState()
+template <class eT>
+typename BasicKF<eT>::colvec* BasicKF<eT>::GetCurrentState()
 {
     return & x_;
 }
 
-colvec* KF::GetCurrentOutput()
+template <class eT>
+typename BasicKF<eT>::colvec* BasicKF<eT>::GetCurrentOutput()
 {
     return &z_;
 }
 
-colvec* KF::GetCurrentEstimatedState()
+template <class eT>
+typename BasicKF<eT>::colvec* BasicKF<eT>::GetCurrentEstimatedState()
 {
     return &x_m_;
 }
 
-colvec* KF::GetCurrentEstimatedOutput()
+template <class eT>
+typename BasicKF<eT>::colvec* BasicKF<eT>::GetCurrentEstimatedOutput()
 {
     return &z_m_;
 }
 
+template <class eT>
+double BasicKF<eT>::GetLogLikelihood()
+{
+    return factor_.GetLogLikelihood();
+}
+
+template <class eT>
+double BasicKF<eT>::GetNIS()
+{
+    return factor_.GetNIS();
+}
 
+template <class eT>
+void BasicKF<eT>::SetNoiseGenerator(NoiseGenerator* generator)
+{
+    noiseGenerator_ = generator;
+}
+
+template <class eT>
+NoiseGenerator* BasicKF<eT>::GetNoiseGenerator()
+{
+    return noiseGenerator_ ? noiseGenerator_ : &noise_;
+}
 
+template class BasicKF<float>;
+template class BasicKF<double>;
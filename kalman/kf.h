@@ -32,22 +32,31 @@
 #include <assert.h>
 #include <armadillo>
 
+#include "innovation.h"
+#include "smallmat.h"
+#include "noise.h"
+
 using namespace std;
 using namespace arma;
 
 /*!
  * @brief Kalman filter implementation, for a linear system. 
+ * The element type eT is float or double, see KF and fKF.
  */
-class KF {
+template <class eT>
+class BasicKF {
 public:
+  typedef Mat<eT> mat;      ///< Matrix of the element type
+  typedef Col<eT> colvec;   ///< Column vector of the element type
+
   /*!
    * \brief Constructor, nothing happens here.
    */
-  KF();
+  BasicKF();
   /*!
    * \brief Destructor, nothing happens here.
    */
-  ~KF();
+  ~BasicKF();
   
   /*!
    * @brief Define the system.
@@ -118,7 +127,42 @@ public:
   */
   colvec* GetCurrentEstimatedOutput();
   
+  /*!
+   * @brief Get the log-likelihood of the last measurement.
+   * The density of the innovation under N(0, S), S being the innovation
+   * covariance, for model selection or multiple model filters.
+   * @return Log-likelihood of the last measurement
+   */
+  double GetLogLikelihood();
+  
+  /*!
+   * @brief Get the normalized innovation squared of the last measurement.
+   * Chi-square distributed with n_outputs degrees of freedom when the filter is consistent.
+   * @return innov' S^-1 innov
+   */
+  double GetNIS();
+  
+  /*!
+   * @brief Use another generator for the noise of the simulated system.
+   * The filter does not own it, it must live as long as the filter simulates with it.
+   * @param generator Noise generator, 0 to go back to the own one of the filter
+   */
+  void SetNoiseGenerator(NoiseGenerator* generator);
+  
+  /*!
+   * @brief Get the generator of the noise of the simulated system, to seed it.
+   * @return The generator in use
+   */
+  NoiseGenerator* GetNoiseGenerator();
+  
 private:
+  /*!
+   * @brief Prior and measurement update, shared by both versions of Kalmanf.
+   * Writes only into the workspace, nothing is allocated.
+   * @param z The values of the output from measurement
+   * @param u The applied input to the system
+   */
+  void Update(const colvec& z, const colvec& u);
   
   mat A_;      ///< System matrix
   mat B_;      ///< Input matrix
@@ -128,8 +172,11 @@ private:
   colvec v_;   ///< Gaussian process noise
   colvec w_;   ///< Gaussian measurement noise
   
-  mat sqrt_Q_; ///< Process noise stdev
-  mat sqrt_R_; ///< Measurement noise stdev
+  mat sqrt_Q_; ///< Lower Cholesky factor of Q, the process noise is sqrt_Q_ v_
+  mat sqrt_R_; ///< Lower Cholesky factor of R, the measurement noise is sqrt_R_ w_
+  
+  NoiseGenerator noise_;            ///< Own generator of the noise
+  NoiseGenerator* noiseGenerator_;  ///< Generator in use, 0 for noise_
   
   colvec x_;   ///< State vector
   colvec z_;   ///< Output matrix
@@ -141,6 +188,23 @@ private:
   mat P_m_;    ///< State covariance after measurement update
   
   colvec z_m_; ///< Estimated output
+
+  // Workspace, sized in InitSystem, so that a step allocates nothing
+  mat At_;     ///< Transpose of A
+  mat Ht_;     ///< Transpose of H
+  mat AP_;     ///< A * P_m
+  mat PHt_;    ///< P_p * H'
+  mat S_;      ///< Innovation covariance
+  InnovationFactor<eT> factor_; ///< Cholesky factor of S
+  mat K_;      ///< Kalman gain
+  colvec innov_; ///< Innovation
+  colvec xw_;  ///< Scratch state, for the simulation
 };
 
+/// The Kalman filter in double precision
+typedef BasicKF<double> KF;
+
+/// The Kalman filter in single precision
+typedef BasicKF<float> fKF;
+
 #endif
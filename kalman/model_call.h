@@ -0,0 +1,100 @@
+/**
+ * @file model_call.h
+ * @author agent
+ * @date 19 Oct 2026
+ * @brief Header file for the calls to the models bound at compile time.
+ *
+ * @section DESCRIPTION
+ * EKFT, EKF2T, UKFT and FXT accept a model or a function in two forms, one
+ * returning its result and one writing it into a given vector:
+ * \code
+ * colvec f(const colvec &x, const colvec &u);             // returns the result
+ * void f(const colvec &x, const colvec &u, colvec &out);  // writes into out
+ * \endcode
+ * The calls below pick the in-place form when it exists. Both overloads take a
+ * last argument, given as 0: the int to long conversion makes the returning one
+ * a worse match, so it is only chosen when the in-place one does not compile.
+ */
+
+#ifndef MODEL_CALL_H
+#define MODEL_CALL_H
+
+#include <armadillo>
+
+#include "threadpool.h"
+
+/*!
+ * \brief Call Model::f writing into out, chosen when the model defines the in-place f.
+ */
+template <class M, class V>
+auto CallModelF(M &model, const V &x, const V &u, V &out, int)
+        -> decltype(model.M::f(x, u, out), void()) {
+    model.M::f(x, u, out);
+}
+
+/*!
+ * \brief Call Model::f returning its result.
+ */
+template <class M, class V>
+void CallModelF(M &model, const V &x, const V &u, V &out, long) {
+    out = model.M::f(x, u);
+}
+
+/*!
+ * \brief Call Model::h writing into out, chosen when the model defines the in-place h.
+ */
+template <class M, class V>
+auto CallModelH(M &model, const V &x, V &out, int)
+        -> decltype(model.M::h(x, out), void()) {
+    model.M::h(x, out);
+}
+
+/*!
+ * \brief Call Model::h returning its result.
+ */
+template <class M, class V>
+void CallModelH(M &model, const V &x, V &out, long) {
+    out = model.M::h(x);
+}
+
+/*!
+ * \brief Call a function writing its result into out, chosen when f(x, c, out) is valid.
+ */
+template <class G, class V>
+auto CallFunction(G &f, const V &x, const V &c, V &out, int)
+        -> decltype(f(x, c, out), void()) {
+    f(x, c, out);
+}
+
+/*!
+ * \brief Call a function returning its result.
+ */
+template <class G, class V>
+void CallFunction(G &f, const V &x, const V &c, V &out, long) {
+    out = f(x, c);
+}
+
+/*!
+ * \brief Call body(k, x_k) for each column x_k of X, on the thread pool if there is one.
+ * The columns of X are passed without copying them.
+ * @param pool The thread pool, or 0 to run on the calling thread
+ * @param X System states, one per column
+ * @param body The work on one column
+ */
+template <class eT, class Body>
+void ForEachColumn(ThreadPool *pool, const arma::Mat<eT> &X, Body body) {
+    if (pool) {
+        pool->ParallelFor(X.n_cols, [&](int k, int t) {
+            const arma::Col<eT> x_k(const_cast<eT*>(X.colptr(k)), X.n_rows, false, true);
+            body(k, x_k);
+        });
+        return;
+    }
+
+    for (arma::uword k = 0; k < X.n_cols; k++) {
+        const arma::Col<eT> x_k(const_cast<eT*>(X.colptr(k)), X.n_rows, false, true);
+        body(k, x_k);
+    }
+}
+
+#endif
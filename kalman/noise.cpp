@@ -0,0 +1,153 @@
+/**
+ * @file noise.cpp
+ * @author agent
+ * @date 19 Oct 2026
+ * @brief Noise generator of the simulated systems.
+ */
+
+#include <atomic>
+#include <limits>
+
+#include "noise.h"
+
+/// @cond DEV
+namespace {
+
+const uint64_t DEFAULT_SEED = 0x853c49e6748fea9bULL;
+
+// Stream of the next default generator
+std::atomic<uint64_t> nextStream(0);
+
+inline uint64_t Rotate(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+/*
+ * splitmix64, to spread a seed over the 256 bits of a state.
+ */
+inline uint64_t SplitMix(uint64_t& x)
+{
+    uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+}
+/// @endcond
+
+NoiseGenerator::NoiseGenerator()
+{
+    Seed(DEFAULT_SEED, nextStream++);
+}
+
+NoiseGenerator::~NoiseGenerator()
+{
+
+}
+
+void NoiseGenerator::Seed(uint64_t seed, uint64_t stream)
+{
+    // The stream is added to the hashed seed and the sum is hashed again, so
+    // nearby seeds and streams do not land on the same state. splitmix64 then
+    // draws the states of the lanes one after the other. This costs the same
+    // for any stream
+    uint64_t x = seed;
+    x = SplitMix(x) + stream;
+    x = SplitMix(x);
+    for (int l = 0; l < LANES; l++)
+        for (int w = 0; w < 4; w++)
+            s_[w][l] = SplitMix(x);
+
+    used_ = 2 * LANES;
+}
+
+void NoiseGenerator::Refill()
+{
+    double u[2][LANES];
+
+    for (int k = 0; k < 2; k++) {
+        // One xoshiro256** step of all the lanes, the same operations on each
+        for (int l = 0; l < LANES; l++) {
+            uint64_t r = Rotate(s_[1][l] * 5, 7) * 9;
+            uint64_t t = s_[1][l] << 17;
+            s_[2][l] ^= s_[0][l];
+            s_[3][l] ^= s_[1][l];
+            s_[1][l] ^= s_[2][l];
+            s_[0][l] ^= s_[3][l];
+            s_[2][l] ^= t;
+            s_[3][l] = Rotate(s_[3][l], 45);
+
+            // The top 53 bits, uniform in (0, 1]
+            u[k][l] = ((r >> 11) + 1) * (1.0 / 9007199254740992.0);
+        }
+    }
+
+    // Box-Muller, two Gaussian values from each pair of uniform ones
+    for (int l = 0; l < LANES; l++) {
+        double radius = sqrt(-2 * log(u[0][l]));
+        double angle = 2 * M_PI * u[1][l];
+        block_[2 * l] = radius * cos(angle);
+        block_[2 * l + 1] = radius * sin(angle);
+    }
+
+    used_ = 0;
+}
+
+void NoiseGenerator::Gaussian(double* out, uword n)
+{
+    for (uword i = 0; i < n; i++) {
+        if (used_ == 2 * LANES)
+            Refill();
+        out[i] = block_[used_++];
+    }
+}
+
+void NoiseGenerator::Gaussian(Col<double>& v)
+{
+    Gaussian(v.memptr(), v.n_elem);
+}
+
+void NoiseGenerator::Gaussian(Col<float>& v)
+{
+    for (uword i = 0; i < v.n_elem; i++) {
+        double d;
+        Gaussian(&d, 1);
+        v(i) = (float)d;
+    }
+}
+
+template <class eT>
+void NoiseGenerator::CovarianceFactor(const Mat<eT>& C, Mat<eT>& L)
+{
+    assert(C.is_square() && "Whoops, a covariance must be a square matrix");
+
+    uword n = C.n_rows;
+    L.zeros(n, n);
+
+    // Pivots below this are rounding, their columns are left at zero
+    double scale = 0;
+    for (uword j = 0; j < n; j++)
+        scale = max(scale, fabs((double)C(j, j)));
+    double tiny = scale * n * std::numeric_limits<eT>::epsilon();
+
+    for (uword j = 0; j < n; j++) {
+        double d = C(j, j);
+        for (uword k = 0; k < j; k++)
+            d = d - (double)L(j, k) * L(j, k);
+        if (d <= tiny)
+            continue;
+
+        L(j, j) = sqrt(d);
+        for (uword i = j + 1; i < n; i++) {
+            double sum = C(i, j);
+            for (uword k = 0; k < j; k++)
+                sum = sum - (double)L(i, k) * L(j, k);
+            L(i, j) = sum / L(j, j);
+        }
+    }
+}
+
+template void NoiseGenerator::CovarianceFactor(const Mat<float>& C, Mat<float>& L);
+template void NoiseGenerator::CovarianceFactor(const Mat<double>& C, Mat<double>& L);
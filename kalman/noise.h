@@ -0,0 +1,116 @@
+/**
+ * @file noise.h
+ * @author agent
+ * @date 19 Oct 2026
+ * @brief Header file for the noise generator of the simulated systems.
+ *
+ * @section DESCRIPTION
+ * When a filter simulates its own system, it draws the process and the
+ * measurement noise here instead of from the global generator of Armadillo,
+ * which is shared by the whole program and not safe across threads. Each
+ * filter owns a generator on its own stream, so filters running side by side
+ * or in different threads draw independently, and a seed and a stream number
+ * make a run reproducible.
+ *
+ * The uniform numbers come from four xoshiro256** generators stepped
+ * together, the lanes, whose states sit side by side so the compiler can
+ * step them with vector instructions. The Gaussian numbers are made by the
+ * Box-Muller transform, eight at a time from one step of the lanes. The
+ * states of the lanes are drawn by splitmix64 from the seed mixed with the
+ * stream number, so any stream is found at once. With a period of 2^256 - 1,
+ * the chance that the sequences of two lanes or streams overlap is nil in practice.
+ *
+ * Another source of noise, a recorded one for instance, is plugged in by
+ * deriving from NoiseGenerator and overriding Gaussian(double*, uword).
+ */
+
+#ifndef NOISE_H
+#define NOISE_H
+
+#define ARMA_USE_LAPACK // This definition must be before the include to the armadillo
+
+#define _USE_MATH_DEFINES
+
+#include <math.h>
+#include <stdint.h>
+
+#include <assert.h>
+#include <armadillo>
+
+using namespace std;
+using namespace arma;
+
+/*!
+ * @brief Seedable generator of standard Gaussian noise, one per filter.
+ */
+class NoiseGenerator {
+public:
+    /*!
+     * \brief Constructor, seeded with the default seed on a stream of its own.
+     * The streams are numbered in the order of construction, from any thread,
+     * so no two default generators give the same noise. Call Seed for noise
+     * that does not depend on how many generators were built before.
+     */
+    NoiseGenerator();
+
+    /*!
+     * \brief Destructor, nothing happens here.
+     */
+    virtual ~NoiseGenerator();
+
+    /*!
+     * \brief Restart the noise from a seed.
+     * The same seed and stream give the same noise, whatever the thread.
+     * @param seed Seed
+     * @param stream Stream of the seed, the generators of one seed on different streams are independent
+     */
+    void Seed(uint64_t seed, uint64_t stream = 0);
+
+    /*!
+     * \brief Standard Gaussian noise, zero mean and unit variance.
+     * Override it to plug another source of noise.
+     * @param out n values, this is a returned value
+     * @param n Number of values
+     */
+    virtual void Gaussian(double* out, uword n);
+
+    /*!
+     * \brief Fill a vector with standard Gaussian noise, through Gaussian(double*, uword).
+     * @param v Vector, keeps its size
+     */
+    void Gaussian(Col<double>& v);
+
+    /*!
+     * \brief Fill a vector with standard Gaussian noise, through Gaussian(double*, uword).
+     * @param v Vector, keeps its size
+     */
+    void Gaussian(Col<float>& v);
+
+    /*!
+     * \brief The factor that turns unit noise into noise of covariance C.
+     * L is the lower Cholesky factor of C, L L' = C. C may be only positive
+     * semi-definite, as a Q with noiseless states: the columns of L of the pivots
+     * that are zero to rounding are zero. For a diagonal C, L is its elementwise
+     * square root.
+     * @param C Covariance, only its lower triangle is read
+     * @param L Factor, this is a returned value
+     */
+    template <class eT>
+    static void CovarianceFactor(const Mat<eT>& C, Mat<eT>& L);
+
+private:
+    /// @cond DEV
+    static const int LANES = 4;
+
+    /*!
+     * \brief Step the lanes twice and turn their output into block_.
+     */
+    void Refill();
+
+    uint64_t s_[4][LANES];      ///< States of the lanes, word by word
+    double block_[2 * LANES];   ///< Gaussian values not used yet
+    int used_;                  ///< Number of the values of block_ already used
+    /// @endcond
+};
+
+#endif
@@ -0,0 +1,239 @@
+/**
+ * @file smallmat.cpp
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Small matrix operations of the filters, and the choice of their kernels.
+ */
+
+#include "smallmat.h"
+#include "smallmat_kernels.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+namespace {
+
+/// @cond DEV
+/*
+ * The plain loops, in the same column order as the SIMD kernels.
+ */
+template <class eT>
+void ScalarSolveLowerTrans(int n, int m, const eT* L, const eT* B, eT* X)
+{
+    for (int i = 0; i < m; i++) {
+        eT* x = X + i * n;
+        for (int r = 0; r < n; r++)
+            x[r] = B[r + i * n];
+        for (int j = 0; j < i; j++) {
+            eT s = L[i + j * m];
+            for (int r = 0; r < n; r++)
+                x[r] = x[r] - X[r + j * n] * s;
+        }
+        for (int r = 0; r < n; r++)
+            x[r] = x[r] / L[i + i * m];
+    }
+}
+
+template <class eT>
+void ScalarSolveLower(int n, int m, const eT* L, const eT* B, eT* X)
+{
+    for (int i = m - 1; i >= 0; i--) {
+        eT* x = X + i * n;
+        for (int r = 0; r < n; r++)
+            x[r] = B[r + i * n];
+        for (int j = i + 1; j < m; j++) {
+            eT s = L[j + i * m];
+            for (int r = 0; r < n; r++)
+                x[r] = x[r] - X[r + j * n] * s;
+        }
+        for (int r = 0; r < n; r++)
+            x[r] = x[r] / L[i + i * m];
+    }
+}
+
+template <class eT>
+void FillScalarKernels(SmallKernelTable<eT>& kernels)
+{
+    // Armadillo does the products at least as well as plain loops
+    kernels.multiply = 0;
+    kernels.solveLowerTrans = ScalarSolveLowerTrans<eT>;
+    kernels.solveLower = ScalarSolveLower<eT>;
+    kernels.name = "scalar";
+}
+
+/*
+ * Whether the processor, and the operating system, support the instruction sets.
+ */
+bool ProcessorHasAVX2()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 1);
+    bool fma = (info[2] & (1 << 12)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!fma || !osxsave || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return false;
+#endif
+}
+
+bool ProcessorHasAVX512()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f");
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 0xE6) != 0xE6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 16)) != 0;
+#else
+    return false;
+#endif
+}
+
+/*
+ * The kernels in use, chosen on first use.
+ */
+struct Selection {
+    SmallKernelTable<float> kernels_float;
+    SmallKernelTable<double> kernels_double;
+
+    Selection() {
+        FillScalarKernels(kernels_float);
+        FillScalarKernels(kernels_double);
+        Select(SmallMat::AUTO);
+    }
+
+    bool Select(SmallMat::InstructionSet set) {
+        SmallKernelTable<float> f;
+        SmallKernelTable<double> d;
+
+        if (set == SmallMat::AUTO)
+            return Select(SmallMat::AVX512) || Select(SmallMat::AVX2) || Select(SmallMat::SCALAR);
+
+        if (set == SmallMat::SCALAR) {
+            FillScalarKernels(f);
+            FillScalarKernels(d);
+        }
+        else if (set == SmallMat::AVX2) {
+            if (!ProcessorHasAVX2() || !GetAVX2Kernels(f, d))
+                return false;
+        }
+        else if (set == SmallMat::AVX512) {
+            if (!ProcessorHasAVX512() || !GetAVX512Kernels(f, d))
+                return false;
+        }
+        else
+            return false;
+
+        kernels_float = f;
+        kernels_double = d;
+        return true;
+    }
+
+    const SmallKernelTable<float>& Get(float) const { return kernels_float; }
+    const SmallKernelTable<double>& Get(double) const { return kernels_double; }
+};
+
+Selection& TheSelection()
+{
+    static Selection selection;
+    return selection;
+}
+/// @endcond
+
+}
+
+bool SmallMat::Fits(uword n_rows)
+{
+    return n_rows > 0 && n_rows <= MAX_SIZE;
+}
+
+template <class eT>
+const SmallKernelTable<eT>& SmallMat::Kernels()
+{
+    return TheSelection().Get(eT());
+}
+
+template <class eT>
+void SmallMat::Multiply(const Mat<eT>& A, const Mat<eT>& B, Mat<eT>& C)
+{
+    assert(&C != &A && &C != &B && "Whoops, the product cannot be written over an operand");
+    arma_assert_mul_size(A.n_rows, A.n_cols, B.n_rows, B.n_cols, "Whoops, the operands do not match");
+
+    if (!Fits(A.n_rows) || B.n_rows == 0 || !Kernels<eT>().multiply) {
+        C = A * B;
+        return;
+    }
+
+    C.set_size(A.n_rows, B.n_cols);
+    Kernels<eT>().multiply(A.n_rows, B.n_cols, A.n_cols, A.memptr(), B.memptr(), C.memptr());
+}
+
+template <class eT>
+void SmallMat::Sandwich(const Mat<eT>& A, const Mat<eT>& P, const Mat<eT>& At, Mat<eT>& AP, Mat<eT>& C)
+{
+    Multiply(A, P, AP);
+    Multiply(AP, At, C);
+
+    // The two triangles differ by rounding, keep the lower one so C stays a covariance
+    for (uword j = 0; j < C.n_cols; j++)
+        for (uword i = j + 1; i < C.n_rows; i++)
+            C(j, i) = C(i, j);
+}
+
+template <class eT>
+void SmallMat::SolveLowerTrans(const Mat<eT>& L, const Mat<eT>& B, Mat<eT>& X)
+{
+    assert(&X != &B && "Whoops, the solution cannot be written over the right-hand sides");
+    arma_assert_same_size(L.n_rows, L.n_cols, B.n_cols, B.n_cols, "Whoops, L does not match the right-hand sides");
+
+    X.set_size(B.n_rows, B.n_cols);
+    if (Fits(B.n_rows))
+        Kernels<eT>().solveLowerTrans(B.n_rows, B.n_cols, L.memptr(), B.memptr(), X.memptr());
+    else if (B.n_rows > 0)
+        ScalarSolveLowerTrans<eT>(B.n_rows, B.n_cols, L.memptr(), B.memptr(), X.memptr());
+}
+
+template <class eT>
+void SmallMat::SolveLower(const Mat<eT>& L, const Mat<eT>& B, Mat<eT>& X)
+{
+    assert(&X != &B && "Whoops, the solution cannot be written over the right-hand sides");
+    arma_assert_same_size(L.n_rows, L.n_cols, B.n_cols, B.n_cols, "Whoops, L does not match the right-hand sides");
+
+    X.set_size(B.n_rows, B.n_cols);
+    if (Fits(B.n_rows))
+        Kernels<eT>().solveLower(B.n_rows, B.n_cols, L.memptr(), B.memptr(), X.memptr());
+    else if (B.n_rows > 0)
+        ScalarSolveLower<eT>(B.n_rows, B.n_cols, L.memptr(), B.memptr(), X.memptr());
+}
+
+bool SmallMat::SetInstructionSet(InstructionSet set)
+{
+    return TheSelection().Select(set);
+}
+
+const char* SmallMat::GetInstructionSet()
+{
+    return TheSelection().kernels_double.name;
+}
+
+template void SmallMat::Multiply(const Mat<float>& A, const Mat<float>& B, Mat<float>& C);
+template void SmallMat::Multiply(const Mat<double>& A, const Mat<double>& B, Mat<double>& C);
+template void SmallMat::Sandwich(const Mat<float>& A, const Mat<float>& P, const Mat<float>& At, Mat<float>& AP, Mat<float>& C);
+template void SmallMat::Sandwich(const Mat<double>& A, const Mat<double>& P, const Mat<double>& At, Mat<double>& AP, Mat<double>& C);
+template void SmallMat::SolveLowerTrans(const Mat<float>& L, const Mat<float>& B, Mat<float>& X);
+template void SmallMat::SolveLowerTrans(const Mat<double>& L, const Mat<double>& B, Mat<double>& X);
+template void SmallMat::SolveLower(const Mat<float>& L, const Mat<float>& B, Mat<float>& X);
+template void SmallMat::SolveLower(const Mat<double>& L, const Mat<double>& B, Mat<double>& X);
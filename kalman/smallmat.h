@@ -0,0 +1,123 @@
+/**
+ * @file smallmat.h
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Header file for the small matrix operations of the filters.
+ *
+ * @section DESCRIPTION
+ * The filters mostly work with a few states and outputs, 16 or less. At
+ * that size a product like A * P * A' costs more in the generic dispatch
+ * than in the arithmetic. The operations here go to kernels written for
+ * these sizes: a whole column of the result, up to 16 rows, is kept in
+ * vector registers while the other operand is streamed through.
+ *
+ * The kernels are chosen once, from the processor: AVX-512, else AVX2 with
+ * FMA, else the scalar ones, Armadillo for the products and plain loops for
+ * the solves. On other processors than x86, and when the SIMD files are
+ * compiled without their instruction sets, only the scalar ones are
+ * available. Larger matrices go to Armadillo as before.
+ * The results are the same as Armadillo's to rounding, the SIMD kernels
+ * use fused multiply-adds.
+ */
+
+#ifndef SMALLMAT_H
+#define SMALLMAT_H
+
+#define ARMA_USE_LAPACK // This definition must be before the include to the armadillo
+
+#include <assert.h>
+#include <armadillo>
+
+using namespace std;
+using namespace arma;
+
+template <class eT>
+struct SmallKernelTable;
+
+/*!
+ * @brief Products and triangular solves of small matrices, for float and double.
+ */
+class SmallMat {
+public:
+    /// The kernels that can be used
+    enum InstructionSet {
+        AUTO,     ///< The best the processor supports
+        SCALAR,   ///< Armadillo for the products, plain loops for the solves
+        AVX2,     ///< AVX2 and FMA
+        AVX512    ///< AVX-512F
+    };
+
+    /// Largest number of rows of the results computed by the kernels
+    static const uword MAX_SIZE = 16;
+
+    /*!
+     * \brief Whether the kernels are used for a result with this many rows.
+     * @param n_rows Number of rows of the result
+     */
+    static bool Fits(uword n_rows);
+
+    /*!
+     * \brief C = A B. C must not be A or B.
+     * @param A Left operand
+     * @param B Right operand
+     * @param C Product, this is a returned value
+     */
+    template <class eT>
+    static void Multiply(const Mat<eT>& A, const Mat<eT>& B, Mat<eT>& C);
+
+    /*!
+     * \brief C = A P A', as (A P) A'. A' is taken already transposed, the filters keep it.
+     * The upper triangle of C is the mirror of the lower one, so C is exactly
+     * symmetric, as a covariance must be.
+     * @param A Left operand
+     * @param P Middle operand, a covariance
+     * @param At Transpose of A
+     * @param AP Workspace, this is a returned value
+     * @param C Product, this is a returned value
+     */
+    template <class eT>
+    static void Sandwich(const Mat<eT>& A, const Mat<eT>& P, const Mat<eT>& At, Mat<eT>& AP, Mat<eT>& C);
+
+    /*!
+     * \brief Solve X L' = B, that is X = B L^-T, L lower triangular.
+     * With the Cholesky factor L of a symmetric positive definite S, this and
+     * SolveLower give B S^-1. Any size is accepted, the larger ones use the loops.
+     * @param L Lower triangular matrix, only its lower triangle is read
+     * @param B Right-hand sides, one per row
+     * @param X Solution, this is a returned value
+     */
+    template <class eT>
+    static void SolveLowerTrans(const Mat<eT>& L, const Mat<eT>& B, Mat<eT>& X);
+
+    /*!
+     * \brief Solve X L = B, that is X = B L^-1, L lower triangular.
+     * @param L Lower triangular matrix, only its lower triangle is read
+     * @param B Right-hand sides, one per row
+     * @param X Solution, this is a returned value
+     */
+    template <class eT>
+    static void SolveLower(const Mat<eT>& L, const Mat<eT>& B, Mat<eT>& X);
+
+    /*!
+     * \brief Choose the kernels, to compare them. AUTO is the default.
+     * Not to be called while the filters are running in other threads.
+     * @param set Instruction set
+     * @return False if the processor or the build does not support it, the kernels are then unchanged
+     */
+    static bool SetInstructionSet(InstructionSet set);
+
+    /*!
+     * \brief Name of the kernels in use.
+     * @return "AVX-512", "AVX2" or "scalar"
+     */
+    static const char* GetInstructionSet();
+
+private:
+    /*!
+     * \brief The kernels in use, for the element type eT.
+     */
+    template <class eT>
+    static const SmallKernelTable<eT>& Kernels();
+};
+
+#endif
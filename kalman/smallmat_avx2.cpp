@@ -0,0 +1,74 @@
+/**
+ * @file smallmat_avx2.cpp
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief AVX2 and FMA kernels of the small matrix operations.
+ *
+ * @section DESCRIPTION
+ * This file is compiled with AVX2 and FMA enabled, -mavx2 -mfma or /arch:AVX2.
+ * Its kernels only run once the processor has been checked for them, see smallmat.cpp.
+ */
+
+#include "smallmat_kernels.h"
+
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+
+#include <immintrin.h>
+
+namespace {
+
+/// @cond DEV
+struct AVX2Double {
+    typedef double eT;
+    typedef __m256d reg;
+    typedef __m256i mask;
+    static const int LANES = 4;
+
+    static reg Zero() { return _mm256_setzero_pd(); }
+    static reg Broadcast(eT a) { return _mm256_set1_pd(a); }
+    static mask Tail(int n) { return _mm256_cmpgt_epi64(_mm256_set1_epi64x(n), _mm256_setr_epi64x(0, 1, 2, 3)); }
+    static reg Load(const eT* p) { return _mm256_loadu_pd(p); }
+    static reg LoadTail(const eT* p, mask m) { return _mm256_maskload_pd(p, m); }
+    static void Store(eT* p, reg r) { _mm256_storeu_pd(p, r); }
+    static void StoreTail(eT* p, mask m, reg r) { _mm256_maskstore_pd(p, m, r); }
+    static reg MulAdd(reg a, reg b, reg c) { return _mm256_fmadd_pd(a, b, c); }
+    static reg MulSub(reg a, reg b, reg c) { return _mm256_fnmadd_pd(a, b, c); }
+    static reg Div(reg a, reg b) { return _mm256_div_pd(a, b); }
+};
+
+struct AVX2Float {
+    typedef float eT;
+    typedef __m256 reg;
+    typedef __m256i mask;
+    static const int LANES = 8;
+
+    static reg Zero() { return _mm256_setzero_ps(); }
+    static reg Broadcast(eT a) { return _mm256_set1_ps(a); }
+    static mask Tail(int n) { return _mm256_cmpgt_epi32(_mm256_set1_epi32(n), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)); }
+    static reg Load(const eT* p) { return _mm256_loadu_ps(p); }
+    static reg LoadTail(const eT* p, mask m) { return _mm256_maskload_ps(p, m); }
+    static void Store(eT* p, reg r) { _mm256_storeu_ps(p, r); }
+    static void StoreTail(eT* p, mask m, reg r) { _mm256_maskstore_ps(p, m, r); }
+    static reg MulAdd(reg a, reg b, reg c) { return _mm256_fmadd_ps(a, b, c); }
+    static reg MulSub(reg a, reg b, reg c) { return _mm256_fnmadd_ps(a, b, c); }
+    static reg Div(reg a, reg b) { return _mm256_div_ps(a, b); }
+};
+/// @endcond
+
+}
+
+bool GetAVX2Kernels(SmallKernelTable<float>& kernels_float, SmallKernelTable<double>& kernels_double)
+{
+    FillKernels<AVX2Float>(kernels_float, "AVX2");
+    FillKernels<AVX2Double>(kernels_double, "AVX2");
+    return true;
+}
+
+#else
+
+bool GetAVX2Kernels(SmallKernelTable<float>& kernels_float, SmallKernelTable<double>& kernels_double)
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,75 @@
+/**
+ * @file smallmat_avx512.cpp
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief AVX-512 kernels of the small matrix operations.
+ *
+ * @section DESCRIPTION
+ * This file is compiled with AVX-512F enabled, -mavx512f or /arch:AVX512.
+ * Its kernels only run once the processor has been checked for them, see smallmat.cpp.
+ * A register holds 8 doubles or 16 floats, and the tail of a column is a mask register.
+ */
+
+#include "smallmat_kernels.h"
+
+#if defined(__AVX512F__)
+
+#include <immintrin.h>
+
+namespace {
+
+/// @cond DEV
+struct AVX512Double {
+    typedef double eT;
+    typedef __m512d reg;
+    typedef __mmask8 mask;
+    static const int LANES = 8;
+
+    static reg Zero() { return _mm512_setzero_pd(); }
+    static reg Broadcast(eT a) { return _mm512_set1_pd(a); }
+    static mask Tail(int n) { return (mask)((1u << n) - 1); }
+    static reg Load(const eT* p) { return _mm512_loadu_pd(p); }
+    static reg LoadTail(const eT* p, mask m) { return _mm512_maskz_loadu_pd(m, p); }
+    static void Store(eT* p, reg r) { _mm512_storeu_pd(p, r); }
+    static void StoreTail(eT* p, mask m, reg r) { _mm512_mask_storeu_pd(p, m, r); }
+    static reg MulAdd(reg a, reg b, reg c) { return _mm512_fmadd_pd(a, b, c); }
+    static reg MulSub(reg a, reg b, reg c) { return _mm512_fnmadd_pd(a, b, c); }
+    static reg Div(reg a, reg b) { return _mm512_div_pd(a, b); }
+};
+
+struct AVX512Float {
+    typedef float eT;
+    typedef __m512 reg;
+    typedef __mmask16 mask;
+    static const int LANES = 16;
+
+    static reg Zero() { return _mm512_setzero_ps(); }
+    static reg Broadcast(eT a) { return _mm512_set1_ps(a); }
+    static mask Tail(int n) { return (mask)((1u << n) - 1); }
+    static reg Load(const eT* p) { return _mm512_loadu_ps(p); }
+    static reg LoadTail(const eT* p, mask m) { return _mm512_maskz_loadu_ps(m, p); }
+    static void Store(eT* p, reg r) { _mm512_storeu_ps(p, r); }
+    static void StoreTail(eT* p, mask m, reg r) { _mm512_mask_storeu_ps(p, m, r); }
+    static reg MulAdd(reg a, reg b, reg c) { return _mm512_fmadd_ps(a, b, c); }
+    static reg MulSub(reg a, reg b, reg c) { return _mm512_fnmadd_ps(a, b, c); }
+    static reg Div(reg a, reg b) { return _mm512_div_ps(a, b); }
+};
+/// @endcond
+
+}
+
+bool GetAVX512Kernels(SmallKernelTable<float>& kernels_float, SmallKernelTable<double>& kernels_double)
+{
+    FillKernels<AVX512Float>(kernels_float, "AVX-512");
+    FillKernels<AVX512Double>(kernels_double, "AVX-512");
+    return true;
+}
+
+#else
+
+bool GetAVX512Kernels(SmallKernelTable<float>& kernels_float, SmallKernelTable<double>& kernels_double)
+{
+    return false;
+}
+
+#endif
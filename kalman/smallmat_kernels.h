@@ -0,0 +1,216 @@
+/**
+ * @file smallmat_kernels.h
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Raw kernels of the small matrix operations, see smallmat.h.
+ *
+ * @section DESCRIPTION
+ * The kernels work on packed column-major arrays, as stored by Armadillo.
+ * The SIMD ones keep a whole column of the result, up to 16 rows, in vector
+ * registers. They are written once here, on top of a vector type V, and
+ * instantiated in smallmat_avx2.cpp and smallmat_avx512.cpp, which are the
+ * only files compiled for these instruction sets. Those files must include
+ * nothing else than this header and the intrinsics: an inline function of
+ * a library compiled there could be picked by the linker for the whole
+ * program, and would then run on processors without these instructions.
+ *
+ * A vector type V provides:
+ * - eT, reg, mask, the element, register and tail mask types,
+ * - LANES, the elements per register,
+ * - Zero(), Broadcast(a), Tail(n), the mask of the first n lanes,
+ * - Load(p), LoadTail(p, mask), Store(p, r), StoreTail(p, mask, r),
+ * - MulAdd(a, b, c) = a * b + c, MulSub(a, b, c) = c - a * b, Div(a, b).
+ */
+
+#ifndef SMALLMAT_KERNELS_H
+#define SMALLMAT_KERNELS_H
+
+/*!
+ * @brief The kernels of one instruction set, for the element type eT.
+ */
+template <class eT>
+struct SmallKernelTable {
+    /// C = A B, A is m x k, B is k x n. Null if Armadillo does it
+    void (*multiply)(int m, int n, int k, const eT* A, const eT* B, eT* C);
+
+    /// Solves X L' = B, X and B are n x m, L is m x m lower triangular
+    void (*solveLowerTrans)(int n, int m, const eT* L, const eT* B, eT* X);
+
+    /// Solves X L = B, X and B are n x m, L is m x m lower triangular
+    void (*solveLower)(int n, int m, const eT* L, const eT* B, eT* X);
+
+    /// Name of the instruction set
+    const char* name;
+};
+
+/*!
+ * \brief The AVX2 and FMA kernels, from smallmat_avx2.cpp.
+ * @return False if they were not compiled
+ */
+bool GetAVX2Kernels(SmallKernelTable<float>& kernels_float, SmallKernelTable<double>& kernels_double);
+
+/*!
+ * \brief The AVX-512 kernels, from smallmat_avx512.cpp.
+ * @return False if they were not compiled
+ */
+bool GetAVX512Kernels(SmallKernelTable<float>& kernels_float, SmallKernelTable<double>& kernels_double);
+
+/// @cond DEV
+/*
+ * Columns j to j + NC - 1 of C = A B, NB registers per column.
+ */
+template <class V, int NB, int NC>
+inline void MultiplyColumns(int m, int k, const typename V::eT* A, const typename V::eT* B,
+    typename V::eT* C, typename V::mask tail)
+{
+    typename V::reg acc[NC][NB];
+    for (int c = 0; c < NC; c++)
+        for (int b = 0; b < NB; b++)
+            acc[c][b] = V::Zero();
+
+    for (int p = 0; p < k; p++) {
+        const typename V::eT* a = A + p * m;
+        typename V::reg col[NB];
+        for (int b = 0; b < NB - 1; b++)
+            col[b] = V::Load(a + b * V::LANES);
+        col[NB - 1] = V::LoadTail(a + (NB - 1) * V::LANES, tail);
+
+        for (int c = 0; c < NC; c++) {
+            typename V::reg s = V::Broadcast(B[p + c * k]);
+            for (int b = 0; b < NB; b++)
+                acc[c][b] = V::MulAdd(col[b], s, acc[c][b]);
+        }
+    }
+
+    for (int c = 0; c < NC; c++) {
+        for (int b = 0; b < NB - 1; b++)
+            V::Store(C + c * m + b * V::LANES, acc[c][b]);
+        V::StoreTail(C + c * m + (NB - 1) * V::LANES, tail, acc[c][NB - 1]);
+    }
+}
+
+/*
+ * C = A B, the columns two by two so each column of A is loaded once for both.
+ */
+template <class V, int NB>
+inline void MultiplyBlocks(int m, int n, int k, const typename V::eT* A, const typename V::eT* B,
+    typename V::eT* C)
+{
+    typename V::mask tail = V::Tail(m - (NB - 1) * V::LANES);
+
+    int j = 0;
+    for (; j + 1 < n; j += 2)
+        MultiplyColumns<V, NB, 2>(m, k, A, B + j * k, C + j * m, tail);
+    if (j < n)
+        MultiplyColumns<V, NB, 1>(m, k, A, B + j * k, C + j * m, tail);
+}
+
+/*
+ * X L' = B, forward over the columns: X(:, i) = (B(:, i) - sum_j<i X(:, j) L(i, j)) / L(i, i).
+ */
+template <class V, int NB>
+inline void SolveLowerTransBlocks(int n, int m, const typename V::eT* L, const typename V::eT* B,
+    typename V::eT* X)
+{
+    typename V::mask tail = V::Tail(n - (NB - 1) * V::LANES);
+
+    for (int i = 0; i < m; i++) {
+        typename V::reg acc[NB];
+        for (int b = 0; b < NB - 1; b++)
+            acc[b] = V::Load(B + i * n + b * V::LANES);
+        acc[NB - 1] = V::LoadTail(B + i * n + (NB - 1) * V::LANES, tail);
+
+        for (int j = 0; j < i; j++) {
+            typename V::reg s = V::Broadcast(L[i + j * m]);
+            for (int b = 0; b < NB - 1; b++)
+                acc[b] = V::MulSub(V::Load(X + j * n + b * V::LANES), s, acc[b]);
+            acc[NB - 1] = V::MulSub(V::LoadTail(X + j * n + (NB - 1) * V::LANES, tail), s, acc[NB - 1]);
+        }
+
+        typename V::reg d = V::Broadcast(L[i + i * m]);
+        for (int b = 0; b < NB - 1; b++)
+            V::Store(X + i * n + b * V::LANES, V::Div(acc[b], d));
+        V::StoreTail(X + i * n + (NB - 1) * V::LANES, tail, V::Div(acc[NB - 1], d));
+    }
+}
+
+/*
+ * X L = B, backward over the columns: X(:, i) = (B(:, i) - sum_j>i X(:, j) L(j, i)) / L(i, i).
+ */
+template <class V, int NB>
+inline void SolveLowerBlocks(int n, int m, const typename V::eT* L, const typename V::eT* B,
+    typename V::eT* X)
+{
+    typename V::mask tail = V::Tail(n - (NB - 1) * V::LANES);
+
+    for (int i = m - 1; i >= 0; i--) {
+        typename V::reg acc[NB];
+        for (int b = 0; b < NB - 1; b++)
+            acc[b] = V::Load(B + i * n + b * V::LANES);
+        acc[NB - 1] = V::LoadTail(B + i * n + (NB - 1) * V::LANES, tail);
+
+        for (int j = i + 1; j < m; j++) {
+            typename V::reg s = V::Broadcast(L[j + i * m]);
+            for (int b = 0; b < NB - 1; b++)
+                acc[b] = V::MulSub(V::Load(X + j * n + b * V::LANES), s, acc[b]);
+            acc[NB - 1] = V::MulSub(V::LoadTail(X + j * n + (NB - 1) * V::LANES, tail), s, acc[NB - 1]);
+        }
+
+        typename V::reg d = V::Broadcast(L[i + i * m]);
+        for (int b = 0; b < NB - 1; b++)
+            V::Store(X + i * n + b * V::LANES, V::Div(acc[b], d));
+        V::StoreTail(X + i * n + (NB - 1) * V::LANES, tail, V::Div(acc[NB - 1], d));
+    }
+}
+
+/*
+ * The entry points of the table, they pick the number of registers per column.
+ * Rows must be between 1 and 16.
+ */
+template <class V>
+void Multiply(int m, int n, int k, const typename V::eT* A, const typename V::eT* B, typename V::eT* C)
+{
+    switch ((m + V::LANES - 1) / V::LANES) {
+    case 1: MultiplyBlocks<V, 1>(m, n, k, A, B, C); break;
+    case 2: MultiplyBlocks<V, 2>(m, n, k, A, B, C); break;
+    case 3: MultiplyBlocks<V, 3>(m, n, k, A, B, C); break;
+    default: MultiplyBlocks<V, 4>(m, n, k, A, B, C); break;
+    }
+}
+
+template <class V>
+void SolveLowerTrans(int n, int m, const typename V::eT* L, const typename V::eT* B, typename V::eT* X)
+{
+    switch ((n + V::LANES - 1) / V::LANES) {
+    case 1: SolveLowerTransBlocks<V, 1>(n, m, L, B, X); break;
+    case 2: SolveLowerTransBlocks<V, 2>(n, m, L, B, X); break;
+    case 3: SolveLowerTransBlocks<V, 3>(n, m, L, B, X); break;
+    default: SolveLowerTransBlocks<V, 4>(n, m, L, B, X); break;
+    }
+}
+
+template <class V>
+void SolveLower(int n, int m, const typename V::eT* L, const typename V::eT* B, typename V::eT* X)
+{
+    switch ((n + V::LANES - 1) / V::LANES) {
+    case 1: SolveLowerBlocks<V, 1>(n, m, L, B, X); break;
+    case 2: SolveLowerBlocks<V, 2>(n, m, L, B, X); break;
+    case 3: SolveLowerBlocks<V, 3>(n, m, L, B, X); break;
+    default: SolveLowerBlocks<V, 4>(n, m, L, B, X); break;
+    }
+}
+
+/*
+ * The table of a vector type.
+ */
+template <class V>
+void FillKernels(SmallKernelTable<typename V::eT>& kernels, const char* name)
+{
+    kernels.multiply = Multiply<V>;
+    kernels.solveLowerTrans = SolveLowerTrans<V>;
+    kernels.solveLower = SolveLower<V>;
+    kernels.name = name;
+}
+/// @endcond
+
+#endif
@@ -0,0 +1,95 @@
+/**
+ * @file stencil.h
+ * @author agent
+ * @date 19 Oct 2026
+ * @brief Header file for the shared stencil of the finite-difference Hessians.
+ *
+ * @section DESCRIPTION
+ * All the Hessians of an m-element function of n variables come from the
+ * same n^2 + n + 1 function values: point 0 is x, points 1 ... 2n are
+ * x +/- h_j e_j, the others are x +/- (h_j e_j + h_k e_k) for j < k, in pairs.
+ * FX and FXT both evaluate the function on this stencil and assemble the
+ * Hessians with the functions below.
+ */
+
+#ifndef STENCIL_H
+#define STENCIL_H
+
+#include <armadillo>
+
+/*!
+ * \brief Number of points of the shared Hessian stencil.
+ * \param n Size of x.
+ * \return n^2 + n + 1.
+ */
+inline int StencilSize(int n)
+{
+    return n * n + n + 1;
+}
+
+/*!
+ * \brief Get a point of the shared Hessian stencil.
+ * \param x Center of the stencil.
+ * \param h Step of each element of x.
+ * \param p Index of the point.
+ * \param x0 The point, this is a returned value.
+ */
+template <class eT>
+void StencilPoint(const arma::Col<eT> &x, const arma::Col<eT> &h, int p, arma::Col<eT> &x0)
+{
+    int n = x.n_elem;
+    x0 = x;
+
+    if (p == 0)
+        return;
+
+    if (p <= 2 * n) {
+        int j = (p - 1) % n;
+        x0(j) = (p <= n) ? x0(j) + h(j) : x0(j) - h(j);
+        return;
+    }
+
+    // Find the pair of this point
+    int q = (p - 1 - 2 * n) / 2;
+    int j = 0;
+    while (q >= n - 1 - j) {
+        q = q - (n - 1 - j);
+        j++;
+    }
+    int k = j + 1 + q;
+    eT sign = ((p - 1 - 2 * n) % 2 == 0) ? 1 : -1;
+    x0(j) = x0(j) + sign * h(j);
+    x0(k) = x0(k) + sign * h(k);
+}
+
+/*!
+ * \brief Compute the Hessians of all elements from the function values on the stencil.
+ * \param y Function values, one column per stencil point.
+ * \param h Step of each element of x.
+ * \param hess Hessians, one slice per element, this is a returned value.
+ */
+template <class eT>
+void AssembleHessians(const arma::Mat<eT> &y, const arma::Col<eT> &h, arma::Cube<eT> &hess)
+{
+    int n = h.n_elem;
+
+    hess.set_size(n, n, y.n_rows);
+
+    for (arma::uword i = 0; i < y.n_rows; i++) {
+        for (int j = 0; j < n; j++)
+            hess(j, j, i) = (y(i, 1 + j) - 2 * y(i, 0) + y(i, 1 + n + j)) / (h(j) * h(j));
+
+        int c = 1 + 2 * n;
+        for (int j = 0; j < n; j++) {
+            for (int k = j + 1; k < n; k++) {
+                eT d = y(i, c) + y(i, c + 1) + 2 * y(i, 0)
+                    - y(i, 1 + j) - y(i, 1 + n + j) - y(i, 1 + k) - y(i, 1 + n + k);
+                hess(j, k, i) = d / (2 * h(j) * h(k));
+                hess(k, j, i) = hess(j, k, i);
+                c = c + 2;
+            }
+        }
+    }
+}
+
+#endif
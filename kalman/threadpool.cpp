@@ -0,0 +1,132 @@
+/**
+ * @file threadpool.cpp
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief A small persistent thread pool.
+ */
+
+#include "threadpool.h"
+
+ThreadPool::ThreadPool()
+    : job_(0), nJobs_(0), nextJob_(0), nBusy_(0), generation_(0), stop_(false)
+{
+
+}
+
+ThreadPool::~ThreadPool()
+{
+    Stop();
+}
+
+ThreadPool::ThreadPool(const ThreadPool& other)
+    : job_(0), nJobs_(0), nextJob_(0), nBusy_(0), generation_(0), stop_(false)
+{
+    Start(other.GetNumberOfThreads());
+}
+
+ThreadPool& ThreadPool::operator=(const ThreadPool& other)
+{
+    if (this != &other)
+        Start(other.GetNumberOfThreads());
+    return *this;
+}
+
+void ThreadPool::Start(int n_threads)
+{
+    Stop();
+
+    stop_ = false;
+    for (int t = 1; t < n_threads; t++)
+        workers_.push_back(std::thread(&ThreadPool::WorkerLoop, this, t, generation_));
+}
+
+void ThreadPool::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    start_.notify_all();
+
+    for (size_t k = 0; k < workers_.size(); k++)
+        workers_[k].join();
+    workers_.clear();
+}
+
+int ThreadPool::GetNumberOfThreads() const
+{
+    return (int)workers_.size() + 1;
+}
+
+void ThreadPool::ParallelFor(int n_jobs, const std::function<void(int i, int t)>& job)
+{
+    // Nothing to share, do it here
+    if (workers_.empty() || n_jobs < 2) {
+        for (int i = 0; i < n_jobs; i++)
+            job(i, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        job_ = &job;
+        nJobs_ = n_jobs;
+        nextJob_ = 0;
+        nBusy_ = (int)workers_.size();
+        generation_++;
+    }
+    start_.notify_all();
+
+    // The calling thread works too
+    RunJobs(0);
+
+    // job is not used anymore once the workers are done, even after a throw
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (nBusy_ > 0)
+            done_.wait(lock);
+        job_ = 0;
+        error = error_;
+        error_ = std::exception_ptr();
+    }
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+void ThreadPool::WorkerLoop(int t, unsigned long seen)
+{
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!stop_ && generation_ == seen)
+                start_.wait(lock);
+            if (stop_)
+                return;
+            seen = generation_;
+        }
+
+        RunJobs(t);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--nBusy_ == 0)
+            done_.notify_one();
+    }
+}
+
+void ThreadPool::RunJobs(int t)
+{
+    for (int i = nextJob_++; i < nJobs_; i = nextJob_++) {
+        try {
+            (*job_)(i, t);
+        }
+        catch (...) {
+            // Keep the first exception for the calling thread and skip the jobs left
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!error_)
+                error_ = std::current_exception();
+            nextJob_ = nJobs_;
+        }
+    }
+}
@@ -0,0 +1,115 @@
+/**
+ * @file threadpool.h
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Header file for a small persistent thread pool.
+ *
+ * @section DESCRIPTION
+ * The pool is used by the filters to spread independent model evaluations
+ * (Jacobian columns, Hessian stencils, sigma points) over several cores.
+ * The worker threads are created once and sleep between two parallel loops,
+ * so a parallel loop costs a wake-up instead of a thread creation.
+ * A copy of a pool starts its own workers, so the filters that hold a pool
+ * can still be copied.
+ */
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*!
+ * @brief A persistent pool of worker threads running parallel for-loops.
+ */
+class ThreadPool {
+public:
+    /*!
+     * \brief Constructor, no thread is created here.
+     */
+    ThreadPool();
+
+    /*!
+     * \brief Destructor, stop and join all worker threads.
+     */
+    ~ThreadPool();
+
+    /*!
+     * \brief Copy constructor, start as many threads as the other pool, none is shared.
+     * @param other The pool to copy
+     */
+    ThreadPool(const ThreadPool& other);
+
+    /*!
+     * \brief Replace the workers by as many threads as the other pool has.
+     * @param other The pool to copy
+     * @return This pool
+     */
+    ThreadPool& operator=(const ThreadPool& other);
+
+    /*!
+     * \brief Create the worker threads.
+     * The calling thread also takes part in every parallel loop, hence
+     * n_threads - 1 worker threads are created. Calling this function again
+     * replaces the previous workers.
+     * @param n_threads Total number of threads, 1 means no parallelism at all
+     */
+    void Start(int n_threads);
+
+    /*!
+     * \brief Stop and join all worker threads.
+     */
+    void Stop();
+
+    /*!
+     * \brief Total number of threads, including the calling thread.
+     * @return Number of threads taking part in a parallel loop
+     */
+    int GetNumberOfThreads() const;
+
+    /*!
+     * \brief Run job(i, t) for i = 0 ... n_jobs - 1 and wait until all of them are done.
+     * The argument t is the index of the thread running the job, between 0 and
+     * GetNumberOfThreads() - 1, and can be used to pick a per-thread scratch space.
+     * If a job throws, the jobs not started yet are skipped, and the first
+     * exception is rethrown here once all the threads are done with the loop.
+     * This function is not reentrant, do not call it from inside a job.
+     * @param n_jobs Number of jobs
+     * @param job The job to run
+     */
+    void ParallelFor(int n_jobs, const std::function<void(int i, int t)>& job);
+
+private:
+    /*!
+     * \brief Main loop of a worker thread.
+     * @param t Index of the worker thread
+     * @param seen Last loop already known when the thread is created
+     */
+    void WorkerLoop(int t, unsigned long seen);
+
+    /*!
+     * \brief Take jobs from the current loop until none is left.
+     * @param t Index of the thread taking the jobs
+     */
+    void RunJobs(int t);
+
+    std::vector<std::thread> workers_;              ///< Worker threads
+    std::mutex mutex_;                              ///< Protects the loop state
+    std::condition_variable start_;                 ///< Signals a new loop or a stop
+    std::condition_variable done_;                  ///< Signals the end of a loop
+
+    const std::function<void(int, int)>* job_;      ///< Job of the current loop
+    int nJobs_;                                     ///< Number of jobs of the current loop
+    std::atomic<int> nextJob_;                      ///< Next job to be taken
+    int nBusy_;                                     ///< Workers still running the current loop
+    unsigned long generation_;                      ///< Counts the loops, wakes the workers up
+    bool stop_;                                     ///< Tells the workers to quit
+    std::exception_ptr error_;                      ///< First exception thrown by a job of the current loop
+};
+
+#endif
@@ -7,17 +7,25 @@
 
 #include "ukf.h"
 
-UKF::UKF()
-{
+#include <limits>
 
+template <class eT>
+BasicUKF<eT>::BasicUKF()
+{
+  modelThreadSafe_ = false;
+  repairs_ = 0;
+  noiseGenerator_ = 0;
 }
 
-UKF::~UKF()
+template <class eT>
+BasicUKF<eT>::~BasicUKF()
 {
 
 }
 
-void UKF::InitSystem(int n_states, int n_outputs, const mat& Q, const mat& R)
+template <class eT>
+void BasicUKF<eT>::InitSystem(int n_states, int n_outputs, const mat& Q, const mat& R,
+    double alpha, double beta, double kappa)
 {
   assert(Q.is_square() && 
       "Whoops, Q must be a square matrix");
@@ -30,9 +38,10 @@ void UKF::InitSystem(int n_states, int n_outputs, const mat& Q, const mat& R)
   Q_ = Q;
   R_ = R;
   
-  // Stdev is sqrt of variance
-  sqrt_Q_ = sqrt(Q_);
-  sqrt_R_ = sqrt(R_);
+  // Cholesky factors of the noise covariances, the simulation draws unit noise
+  // through them and the square-root form takes them as the noise roots
+  NoiseGenerator::CovarianceFactor(Q_, sqrt_Q_);
+  NoiseGenerator::CovarianceFactor(R_, sqrt_R_);
 
   v_.resize(n_states);
   w_.resize(n_outputs);
@@ -52,23 +61,228 @@ void UKF::InitSystem(int n_states, int n_outputs, const mat& Q, const mat& R)
   // Inital values for the Kalman iterations
   P_ = P_.eye();
   x_m_ = x_m_.zeros();
+
+  alpha_ = alpha;
+  beta_ = beta;
+  kappa_ = kappa;
+  pointSet_ = SYMMETRIC;
+  InitSigmaPoints();
+
+  squareRoot_ = false;
+  linearProcess_ = false;
+  linearMeasurement_ = false;
+  repairs_ = 0;
+}
+
+template <class eT>
+void BasicUKF<eT>::SetSigmaPoints(SigmaPointSet set)
+{
+  pointSet_ = set;
+  InitSigmaPoints();
+}
+
+template <class eT>
+void BasicUKF<eT>::SetSquareRoot(bool square_root)
+{
+  if (square_root && !squareRoot_ && !FactorCovariance(P_, S_))
+    repairs_++;
+  else if (!square_root && squareRoot_)
+    P_ = S_ * trans(S_);
+
+  squareRoot_ = square_root;
+}
+
+template <class eT>
+void BasicUKF<eT>::SetLinearProcess(const mat& F)
+{
+  arma_assert_same_size(F.n_rows, F.n_cols, (uword)nStates_, (uword)nStates_, "Whoops, F must be n_states x n_states");
+  F_ = F;
+  Ft_ = trans(F_);
+  linearProcess_ = true;
+}
+
+template <class eT>
+void BasicUKF<eT>::SetLinearMeasurement(const mat& H)
+{
+  arma_assert_same_size(H.n_rows, H.n_cols, (uword)nOutputs_, (uword)nStates_, "Whoops, H must be n_outputs x n_states");
+  H_ = H;
+  Ht_ = trans(H_);
+  linearMeasurement_ = true;
+}
+
+template <class eT>
+void BasicUKF<eT>::SetModelThreadSafe(bool thread_safe)
+{
+  modelThreadSafe_ = thread_safe;
+}
+
+template <class eT>
+void BasicUKF<eT>::SetSigmaPointThreads(int n_threads)
+{
+  assert(n_threads > 0 && "Whoops, at least one thread is needed");
+
+  pool_.Start(n_threads);
+}
+
+template <class eT>
+void BasicUKF<eT>::InitSigmaPoints()
+{
+  int n = nStates_;
+  int n_sigma;
+
+  if (pointSet_ == SPHERICAL_SIMPLEX) {
+    // Julier's spherical simplex, built one dimension at a time, with a zero
+    // center weight, then scaled by alpha
+    n_sigma = n + 2;
+    double w = 1.0 / (n + 1);
+
+    U_.zeros(n, n_sigma);
+    U_(0, 1) = -1 / sqrt(2 * w);
+    U_(0, 2) = 1 / sqrt(2 * w);
+    for (int j = 2; j <= n; j++) {
+      double s = 1 / sqrt(j * (j + 1) * w);
+      for (int i = 1; i <= j; i++)
+        U_(j - 1, i) = -s;
+      U_(j - 1, j + 1) = j * s;
+    }
+    U_ *= alpha_;
+
+    Wm_.set_size(n_sigma);
+    Wm_.fill(w / (alpha_ * alpha_));
+    Wm_(0) = 1 - 1 / (alpha_ * alpha_);                   // weights for means
+    Wc_ = trans(Wm_);
+    Wc_(0) = Wc_(0) + (1 - alpha_ * alpha_ + beta_);      // weights for covariance
+  }
+  else if (pointSet_ == CUBATURE) {
+    // +/- sqrt(n) along each axis, all weights are equal and positive
+    n_sigma = 2 * n;
+
+    U_.zeros(n, n_sigma);
+    U_.cols(0, n - 1).diag().fill(sqrt((double)n));
+    U_.cols(n, 2 * n - 1).diag().fill(-sqrt((double)n));
+
+    Wm_.set_size(n_sigma);
+    Wm_.fill(1.0 / n_sigma);
+    Wc_ = trans(Wm_);
+  }
+  else {
+    // The center, then +/- sqrt(n + lambda) along each axis
+    n_sigma = 2 * n + 1;
+    double lambda = alpha_ * alpha_ * (n + kappa_) - n;
+    double c = n + lambda;
+
+    U_.zeros(n, n_sigma);
+    U_.cols(1, n).diag().fill(sqrt(c));
+    U_.cols(n + 1, 2 * n).diag().fill(-sqrt(c));
+
+    Wm_.set_size(n_sigma);
+    Wm_.fill(0.5 / c);
+    Wm_(0) = lambda / c;                                  // weights for means
+    Wc_ = trans(Wm_);
+    Wc_(0) = Wc_(0) + (1 - alpha_ * alpha_ + beta_);      // weights for covariance
+  }
+
+  // Buffers, overwritten in place at every step
+  A_.set_size(n, n);
+  X_.set_size(n, n_sigma);
+  X_post_.set_size(n, n_sigma);
+  Y_post_.set_size(nOutputs_, n_sigma);
+  dX_.set_size(n, n_sigma);
+  dY_.set_size(nOutputs_, n_sigma);
+  dXw_.set_size(n, n_sigma);
+  dYw_.set_size(nOutputs_, n_sigma);
+  dXt_.set_size(n_sigma, n);
+  dYt_.set_size(n_sigma, nOutputs_);
+
+  x_pre_.set_size(n);
+  y_pre_.set_size(nOutputs_);
+  innov_.set_size(nOutputs_);
+  Pxx_.set_size(n, n);
+  Pyy_.set_size(nOutputs_, nOutputs_);
+  Pxy_.set_size(n, nOutputs_);
+  K_.set_size(n, nOutputs_);
+  factor_.SetSize(n, nOutputs_);
+  Sy_.set_size(nOutputs_, nOutputs_);
+  HSt_.set_size(n, nOutputs_);
+  dev_.set_size(n);
+  Sp_.set_size(n, n);
+  xw_.set_size(n);
 }
 
-colvec UKF::f(const colvec &x, const colvec &u)
+template <class eT>
+typename BasicUKF<eT>::colvec BasicUKF<eT>::f(const colvec &x, const colvec &u)
 {
   colvec xk(nOutputs_);
   xk = xk.zeros();
   return xk;
 }
 
-colvec UKF::h(const colvec &x)
+template <class eT>
+typename BasicUKF<eT>::colvec BasicUKF<eT>::h(const colvec &x)
 {
   colvec zk(nOutputs_);
   zk = zk.zeros();
   return zk;
 }
 
-void UKF::InitSystemState(const colvec& x0)
+template <class eT>
+void BasicUKF<eT>::f(const colvec &x, const colvec &u, colvec &out)
+{
+  out = f(x, u);
+}
+
+template <class eT>
+void BasicUKF<eT>::h(const colvec &x, colvec &out)
+{
+  out = h(x);
+}
+
+template <class eT>
+void BasicUKF<eT>::f_batch(const mat &X, const colvec &u, mat &Y)
+{
+  Y.set_size(nStates_, X.n_cols);
+
+  // The columns of X and Y are passed to f without copying them
+  if (modelThreadSafe_ && pool_.GetNumberOfThreads() > 1) {
+    pool_.ParallelFor(X.n_cols, [&](int k, int t) {
+      const colvec x_k(const_cast<eT*>(X.colptr(k)), X.n_rows, false, true);
+      colvec y_k(Y.colptr(k), Y.n_rows, false, true);
+      f(x_k, u, y_k);
+    });
+    return;
+  }
+
+  for (uword k = 0; k < X.n_cols; k++) {
+    const colvec x_k(const_cast<eT*>(X.colptr(k)), X.n_rows, false, true);
+    colvec y_k(Y.colptr(k), Y.n_rows, false, true);
+    f(x_k, u, y_k);
+  }
+}
+
+template <class eT>
+void BasicUKF<eT>::h_batch(const mat &X, mat &Y)
+{
+  Y.set_size(nOutputs_, X.n_cols);
+
+  // The columns of X and Y are passed to h without copying them
+  if (modelThreadSafe_ && pool_.GetNumberOfThreads() > 1) {
+    pool_.ParallelFor(X.n_cols, [&](int k, int t) {
+      const colvec x_k(const_cast<eT*>(X.colptr(k)), X.n_rows, false, true);
+      colvec y_k(Y.colptr(k), Y.n_rows, false, true);
+      h(x_k, y_k);
+    });
+    return;
+  }
+
+  for (uword k = 0; k < X.n_cols; k++) {
+    const colvec x_k(const_cast<eT*>(X.colptr(k)), X.n_rows, false, true);
+    colvec y_k(Y.colptr(k), Y.n_rows, false, true);
+    h(x_k, y_k);
+  }
+}
+
+template <class eT>
+void BasicUKF<eT>::InitSystemState(const colvec& x0)
 {
   arma_assert_same_size(x_.n_rows, x_.n_cols, x0.n_rows, x0.n_cols, 
       "Whoops, error initializing system states");
@@ -76,159 +290,377 @@ void UKF::InitSystemState(const colvec& x0)
   x_m_ = x0;
 }
 
-void UKF::InitSystemStateCovariance(const mat& P0)
+template <class eT>
+void BasicUKF<eT>::InitSystemStateCovariance(const mat& P0)
 {
   arma_assert_same_size(P0.n_rows, P0.n_cols, P_.n_rows, P_.n_cols, 
       "Whoops, error initializing state covariance");
   P_ = P0;
+
+  if (squareRoot_ && !FactorCovariance(P_, S_))
+    repairs_++;
 }
 
+template <class eT>
+void BasicUKF<eT>::SquareRootFactor(const mat& dev, const mat& noise_root, mat& C, mat& S)
+{
+  uword n = dev.n_rows;
+  uword n_pos = 0;
+  for (uword k = 0; k < dev.n_cols; k++)
+    n_pos = n_pos + (Wc_(k) > 0);
+
+  // [sqrt(Wc_k) dev_k ... noise_root]' = Q R, then R' R is the sum we want
+  C.set_size(n_pos + n, n);
+  uword r = 0;
+  for (uword k = 0; k < dev.n_cols; k++) {
+    if (Wc_(k) > 0) {
+      double w = sqrt(Wc_(k));
+      for (uword i = 0; i < n; i++)
+        C(r, i) = w * dev(i, k);
+      r++;
+    }
+  }
+  for (uword j = 0; j < n; j++) {
+    for (uword i = 0; i < n; i++)
+      C(n_pos + j, i) = noise_root(i, j);
+  }
+  TriangularFactor(C, S);
+
+  // Sigma points with a negative weight, typically the center one. C is no
+  // longer needed, its first column holds the vector of the downdate
+  colvec d(C.colptr(0), n, false, true);
+  for (uword k = 0; k < dev.n_cols; k++) {
+    if (Wc_(k) < 0) {
+      d = sqrt(-Wc_(k)) * dev.col(k);
+      if (!CholUpdate(S, d, -1)) {
+        // S is partly downdated, factor the whole weighted sum instead
+        repairs_++;
+        mat P = dev;
+        P.each_row() %= Wc_;
+        P = P * trans(dev) + noise_root * trans(noise_root);
+        FactorCovariance(P, S);
+        return;
+      }
+    }
+  }
+}
 
-void UKF::UKalmanf(const colvec& u)
+template <class eT>
+void BasicUKF<eT>::LinearSquareRootFactor(const mat& M, const mat& noise_root, mat& C, mat& S)
 {
-    // Simulate true system, with noise
-    // randn uses a normal/Gaussian distribution, zero mean and unit variance
-    v_.randn(nStates_);
-    w_.randn(nOutputs_);
-    v_ = sqrt_Q_ * v_;
-    w_ = sqrt_R_ * w_;
-    x_ = f(x_, u) + v_;
-    z_ = h(x_) + w_;
-
- 
-    // Calculate sigma points
-    double alpha = 1e-3;                            // default, tunable
-    double ki = 0;                                  // default, tunable
-    double beta = 2;                                // default, tunable
-    double lambda = alpha * alpha * (nStates_ + ki) - nStates_;  
-    double c = nStates_ + lambda;                          
-
-    mat Wm = ones(1, 2 * nStates_ + 1);
-    Wm = Wm * 0.5 / c;
-    Wm.at(0, 0) = lambda / c;                                // weights for means
-    mat Wc = Wm;
-    Wc.at(0, 0) = Wc.at(0, 0) + (1 - alpha * alpha + beta);  // weights for covariance
-
-    mat A = sqrt(c) * chol(P_, "lower");
-
-    mat B = repmat(x_m_, 1, nStates_);
-    mat X = x_m_;
-    X.insert_cols(1, B + A);;
-    X.insert_cols(1 + nStates_, B - A);;
-
-    // Unscented transformation of process
-    mat X_post;
-    colvec x_pre(nStates_);
-    x_pre.zeros(nStates_);
-
-    for (uword k = 0; k < X.n_cols; k++)
-    {
-        X_post.insert_cols(k, f(X.col(k), u));
-        x_pre = x_pre + Wm.at(0,k)*X_post.col(k);
+  // [M noise_root]' = Q R, then R' R = M M' + noise_root noise_root'
+  C.set_size(M.n_cols + noise_root.n_cols, M.n_rows);
+  for (uword i = 0; i < M.n_rows; i++) {
+    for (uword j = 0; j < M.n_cols; j++)
+      C(j, i) = M(i, j);
+    for (uword j = 0; j < noise_root.n_cols; j++)
+      C(M.n_cols + j, i) = noise_root(i, j);
+  }
+  TriangularFactor(C, S);
+}
+
+template <class eT>
+void BasicUKF<eT>::TriangularFactor(mat& C, mat& S)
+{
+  uword m = C.n_rows;
+  uword n = C.n_cols;
+
+  // Householder reflections, column by column, leave R in the upper triangle of C
+  for (uword k = 0; k < n; k++) {
+    double norm2 = 0;
+    for (uword i = k; i < m; i++)
+      norm2 = norm2 + C(i, k) * C(i, k);
+    if (norm2 == 0)
+      continue;
+
+    // v = x - alpha e_1, the sign of alpha avoids cancellation
+    double alpha = (C(k, k) > 0) ? -sqrt(norm2) : sqrt(norm2);
+    double v0 = C(k, k) - alpha;
+    double vtv = norm2 - C(k, k) * C(k, k) + v0 * v0;
+    C(k, k) = v0;
+
+    for (uword j = k + 1; j < n; j++) {
+      double d = 0;
+      for (uword i = k; i < m; i++)
+        d = d + C(i, k) * C(i, j);
+      d = 2 * d / vtv;
+      for (uword i = k; i < m; i++)
+        C(i, j) = C(i, j) - d * C(i, k);
     }
-    mat dX = X_post - repmat(x_pre, 1, X.n_cols);   
-    mat Pxx = dX * diagmat(Wc) * trans(dX) + Q_;
-
-    // Unscented transformation of measurement
-    mat Y_post;
-    colvec y_pre;
-    y_pre.zeros(nOutputs_);
-
-    for (uword k = 0; k < X_post.n_cols; k++)
-    {
-        Y_post.insert_cols(k, h(X_post.col(k)));
-        y_pre = y_pre + Wm.at(0, k)*Y_post.col(k);
+    C(k, k) = alpha;
+  }
+
+  // S = R', with the rows of R of a negative diagonal flipped
+  S.set_size(n, n);
+  for (uword j = 0; j < n; j++) {
+    double sign = (C(j, j) < 0) ? -1 : 1;
+    for (uword i = 0; i < n; i++)
+      S(i, j) = (i >= j) ? sign * C(j, i) : 0;
+  }
+}
+
+template <class eT>
+bool BasicUKF<eT>::CholUpdate(mat& L, colvec& x, double sign)
+{
+  uword n = L.n_rows;
+
+  for (uword k = 0; k < n; k++) {
+    double r2 = L(k, k) * L(k, k) + sign * x(k) * x(k);
+    if (r2 <= 0)
+      return false;
+
+    double r = sqrt(r2);
+    double c = r / L(k, k);
+    double s = x(k) / L(k, k);
+    L(k, k) = r;
+
+    for (uword i = k + 1; i < n; i++) {
+      L(i, k) = (L(i, k) + sign * s * x(i)) / c;
+      x(i) = c * x(i) - s * L(i, k);
     }
-    mat dY = Y_post - repmat(y_pre, 1, X_post.n_cols);
-    mat Pyy = dY * diagmat(Wc) * trans(dY) + R_;
-    
-    // Covariance update
-    mat Pxy = dX * diagmat(Wc) * trans(dY);        // transformed cross-covariance
-    mat K = Pxy * inv(Pyy);
-    x_m_ = x_pre + K * (z_ - y_pre);               // state update
-    P_ = Pxx - K * Pyy * trans(K);  
+  }
 
-    // Estimated output
-    z_m_ = h(x_m_);  
+  return true;
+}
+
+template <class eT>
+bool BasicUKF<eT>::FactorCovariance(const mat& P, mat& L)
+{
+  if (chol(L, P, "lower"))
+    return true;
+
+  double scale = 0;
+  for (uword j = 0; j < P.n_rows; j++)
+    scale = scale + fabs((double)P(j, j));
+  scale = max(scale / P.n_rows, (double)std::numeric_limits<eT>::min());
+
+  mat Ps;
+  for (double shift = sqrt((double)std::numeric_limits<eT>::epsilon()) * scale;
+      shift <= std::numeric_limits<eT>::max(); shift = 2 * shift) {
+    Ps = P;
+    Ps.diag() += shift;
+    if (chol(L, Ps, "lower"))
+      return false;
+  }
+
+  // Only a P that is not finite gets here
+  L.set_size(P.n_rows, P.n_cols);
+  L.fill(datum::nan);
+  return false;
 }
 
-void UKF::UKalmanf(const colvec& z, const colvec& u)
+template <class eT>
+void BasicUKF<eT>::UKalmanf(const colvec& u)
+{
+    // Simulate true system, with noise
+    // Unit Gaussian noise from the generator of the filter
+    GetNoiseGenerator()->Gaussian(v_);
+    GetNoiseGenerator()->Gaussian(w_);
+    f(x_, u, xw_);
+    x_ = xw_;
+    x_ += sqrt_Q_ * v_;
+    h(x_, z_);
+    z_ += sqrt_R_ * w_;
+
+    UKalmanf(z_, u);
+}
+
+template <class eT>
+void BasicUKF<eT>::UKalmanf(const colvec& z, const colvec& u)
 {    
-    // Calculate sigma points
-    double alpha = 1e-3;                            // default, tunable
-    double ki = 0;                                  // default, tunable
-    double beta = 2;                                // default, tunable
-    double lambda = alpha * alpha * (nStates_ + ki) - nStates_;
-    double c = nStates_ + lambda;
-
-    mat Wm = ones(1, 2 * nStates_ + 1);
-    Wm = Wm * 0.5 / c;
-    Wm.at(0, 0) = lambda / c;                                // weights for means
-    mat Wc = Wm;
-    Wc.at(0, 0) = Wc.at(0, 0) + (1 - alpha * alpha + beta);  // weights for covariance
-
-    mat A = sqrt(c) * chol(P_, "lower");
-
-    mat B = repmat(x_m_, 1, nStates_);
-    mat X = x_m_;
-    X.insert_cols(1, B + A);;
-    X.insert_cols(1 + nStates_, B - A);;
-
-    // Unscented transformation of process
-    mat X_post;
-    colvec x_pre(nStates_);
-    x_pre.zeros(nStates_);
-
-    for (uword k = 0; k < X.n_cols; k++)
-    {
-        X_post.insert_cols(k, f(X.col(k), u));
-        x_pre = x_pre + Wm.at(0, k)*X_post.col(k);
+    if (linearProcess_) {
+        // Exact linear-Gaussian time update, f is evaluated once for the mean
+        f(x_m_, u, x_pre_);
+        if (squareRoot_) {
+            SmallMat::Multiply(F_, S_, FS_);
+            LinearSquareRootFactor(FS_, sqrt_Q_, Cx_, S_);
+        }
+        else {
+            SmallMat::Sandwich(F_, P_, Ft_, FP_, Pxx_);
+            Pxx_ += Q_;
+        }
     }
-    mat dX = X_post - repmat(x_pre, 1, X.n_cols);
-    mat Pxx = dX * diagmat(Wc) * trans(dX) + Q_;
-
-    // Unscented transformation of measurement
-    mat Y_post;
-    colvec y_pre;
-    y_pre.zeros(nOutputs_);
-
-    for (uword k = 0; k < X_post.n_cols; k++)
-    {
-        Y_post.insert_cols(k, h(X_post.col(k)));
-        y_pre = y_pre + Wm.at(0, k)*Y_post.col(k);
+    else {
+        // Calculate sigma points
+        if (squareRoot_) {
+            SmallMat::Multiply(S_, U_, X_);
+        }
+        else {
+            if (!FactorCovariance(P_, A_))
+                repairs_++;
+            SmallMat::Multiply(A_, U_, X_);
+        }
+        X_.each_col() += x_m_;
+
+        // Unscented transformation of process
+        f_batch(X_, u, X_post_);
+        x_pre_ = X_post_ * Wm_;
+        dX_ = X_post_;
+        dX_.each_col() -= x_pre_;
+        dXw_ = dX_;
+        dXw_.each_row() %= Wc_;
+        if (squareRoot_) {
+            SquareRootFactor(dX_, sqrt_Q_, Cx_, S_);
+        }
+        else {
+            dXt_ = trans(dX_);
+            SmallMat::Multiply(dXw_, dXt_, Pxx_);
+            Pxx_ += Q_;
+        }
     }
-    mat dY = Y_post - repmat(y_pre, 1, X_post.n_cols);
-    mat Pyy = dY * diagmat(Wc) * trans(dY) + R_;
+
+    if (linearMeasurement_) {
+        // Exact linear-Gaussian measurement update, h is evaluated once for the mean
+        h(x_pre_, y_pre_);
+        if (squareRoot_) {
+            SmallMat::Multiply(H_, S_, HS_);
+            HSt_ = trans(HS_);
+            SmallMat::Multiply(S_, HSt_, Pxy_);
+            LinearSquareRootFactor(HS_, sqrt_R_, Cy_, Sy_);
+        }
+        else {
+            SmallMat::Multiply(Pxx_, Ht_, Pxy_);
+            SmallMat::Multiply(H_, Pxy_, Pyy_);
+            Pyy_ += R_;
+        }
+    }
+    else {
+        if (linearProcess_) {
+            // No propagated sigma points yet, draw them around the prediction
+            if (squareRoot_) {
+                SmallMat::Multiply(S_, U_, X_post_);
+            }
+            else {
+                if (!FactorCovariance(Pxx_, A_))
+                    repairs_++;
+                SmallMat::Multiply(A_, U_, X_post_);
+            }
+            dX_ = X_post_;
+            X_post_.each_col() += x_pre_;
+            dXw_ = dX_;
+            dXw_.each_row() %= Wc_;
+        }
+
+        // Unscented transformation of measurement
+        h_batch(X_post_, Y_post_);
+        y_pre_ = Y_post_ * Wm_;
+        dY_ = Y_post_;
+        dY_.each_col() -= y_pre_;
+        dYt_ = trans(dY_);
+        SmallMat::Multiply(dXw_, dYt_, Pxy_);  // transformed cross-covariance
+
+        if (squareRoot_) {
+            SquareRootFactor(dY_, sqrt_R_, Cy_, Sy_);
+        }
+        else {
+            dYw_ = dY_;
+            dYw_.each_row() %= Wc_;
+            SmallMat::Multiply(dYw_, dYt_, Pyy_);
+            Pyy_ += R_;
+        }
+    }
+
+    // K = Pxy Pyy^-1, from the Cholesky factor of Pyy, which the
+    // square-root form already has
+    if (squareRoot_)
+        factor_.SetFactor(Sy_);
+    else
+        factor_.Factor(Pyy_);
+    factor_.Gain(Pxy_, K_);
 
     // Covariance update
-    mat Pxy = dX * diagmat(Wc) * trans(dY);        // transformed cross-covariance
-    mat K = Pxy * inv(Pyy);
-    x_m_ = x_pre + K * (z - y_pre);               // state update
-    P_ = Pxx - K * Pyy * trans(K);
+    innov_ = z;
+    innov_ -= y_pre_;
+    factor_.Evaluate(innov_);
+    x_m_ = x_pre_;
+    x_m_ += K_ * innov_;                           // state update
+
+    if (squareRoot_) {
+        // P = Pxx - (K Sy) (K Sy)', one downdate per output
+        const mat &KSy = factor_.GetScaledGain();
+        Sp_ = S_;
+        for (int j = 0; j < nOutputs_; j++) {
+            dev_ = KSy.col(j);
+            if (!CholUpdate(S_, dev_, -1)) {
+                // S_ is partly downdated, factor the whole difference instead
+                repairs_++;
+                FactorCovariance(Sp_ * trans(Sp_) - KSy * trans(KSy), S_);
+                break;
+            }
+        }
+    }
+    else {
+        // P = Pxx - K Pyy K'
+        P_ = Pxx_;
+        factor_.Downdate(P_);
+    }
 
     // Estimated output
-    z_m_ = h(x_m_);
+    h(x_m_, z_m_);
 }
 
-colvec* UKF::GetCurrentState()
+template <class eT>
+typename BasicUKF<eT>::colvec* BasicUKF<eT>::GetCurrentState()
 {
     return & x_;
 }
 
-colvec* UKF::GetCurrentOutput()
+template <class eT>
+typename BasicUKF<eT>::colvec* BasicUKF<eT>::GetCurrentOutput()
 {
     return &z_;
 }
 
-colvec* UKF::GetCurrentEstimatedState()
+template <class eT>
+typename BasicUKF<eT>::colvec* BasicUKF<eT>::GetCurrentEstimatedState()
 {
     return &x_m_;
 }
 
 
-colvec* UKF::GetCurrentEstimatedOutput()
+template <class eT>
+typename BasicUKF<eT>::colvec* BasicUKF<eT>::GetCurrentEstimatedOutput()
 {
     return &z_m_;
 }
 
+template <class eT>
+double BasicUKF<eT>::GetLogLikelihood()
+{
+    return factor_.GetLogLikelihood();
+}
+
+template <class eT>
+double BasicUKF<eT>::GetNIS()
+{
+    return factor_.GetNIS();
+}
+
+template <class eT>
+int BasicUKF<eT>::GetCovarianceRepairs()
+{
+    return repairs_;
+}
+
+template <class eT>
+ThreadPool* BasicUKF<eT>::ModelPool()
+{
+  if (modelThreadSafe_ && pool_.GetNumberOfThreads() > 1)
+    return &pool_;
+  return 0;
+}
+
+template <class eT>
+void BasicUKF<eT>::SetNoiseGenerator(NoiseGenerator* generator)
+{
+    noiseGenerator_ = generator;
+}
+
+template <class eT>
+NoiseGenerator* BasicUKF<eT>::GetNoiseGenerator()
+{
+    return noiseGenerator_ ? noiseGenerator_ : &noise_;
+}
 
+template class BasicUKF<float>;
+template class BasicUKF<double>;
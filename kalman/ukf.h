@@ -23,8 +23,8 @@
  * \f$u\f$ is the input vector\n
  */
 
-#ifndef EKF_H
-#define EKF_H
+#ifndef UKF_H
+#define UKF_H
 
 #define ARMA_USE_LAPACK // This definition must be before the include to the armadillo
 
@@ -36,33 +36,121 @@
 #include <assert.h>
 #include <armadillo>
 
+#include "innovation.h"
+#include "smallmat.h"
+#include "noise.h"
+#include "threadpool.h"
+#include "model_call.h"
+
 using namespace std;
 using namespace arma;
 
 /*!
  * @brief Implemetation of the Unscented Kalman filter. 
  * This class needs to be derived.
+ * The element type eT is float or double, see UKF and fUKF. Inside the
+ * filter and its derived classes, mat, colvec and rowvec are of that type.
  */
-class UKF {
-public:  
+template <class eT>
+class BasicUKF {
+public:
+  typedef Mat<eT> mat;      ///< Matrix of the element type
+  typedef Col<eT> colvec;   ///< Column vector of the element type
+  typedef Row<eT> rowvec;   ///< Row vector of the element type
+
+  /*!
+   * @brief Sets of sigma points.
+   */
+  enum SigmaPointSet {
+    SYMMETRIC,          ///< Scaled symmetric set, 2n + 1 points
+    SPHERICAL_SIMPLEX,  ///< Scaled spherical simplex set, n + 2 points
+    CUBATURE            ///< Third order spherical-radial cubature rule, 2n points, equal weights
+  };
+
   /*!
    * \brief Constructor, nothing happens here.
    */
-  UKF();
+  BasicUKF();
   
   /*!
    * \brief Destructur, nothing happens here.
    */
-  ~UKF();
+  ~BasicUKF();
   
   /*!
    * \brief Tell me how many states and outputs you have!
+   * The sigma point weights are computed here, once.
    * @param n_states Number of the elements on the input vector x
    * @param n_outputs Number of the elements on the otput vector z
    * @param Q Process noise covariance
    * @param R Measurement noise covariance
+   * @param alpha Spread of the sigma points around the mean. A small alpha gives
+   * weights of the order of 1 / alpha^2 that cancel out, in single precision keep
+   * it close to 1 or use the CUBATURE set
+   * @param beta Prior knowledge of the distribution, 2 is optimal for a Gaussian
+   * @param kappa Secondary scaling parameter
+   */
+  void InitSystem(int n_states, int n_outputs, const mat& Q, const mat& R,
+      double alpha = 1e-3, double beta = 2, double kappa = 0);
+
+  /*!
+   * \brief Choose the set of sigma points.
+   * Fewer points mean fewer calls to f and h per step. alpha and beta scale
+   * the symmetric and the simplex sets, kappa only applies to the symmetric set.
+   * The cubature rule has no parameter.
+   * Must be called after InitSystem.
+   * If not called, the symmetric set is used.
+   * @param set The set of sigma points
+   */
+  void SetSigmaPoints(SigmaPointSet set);
+
+  /*!
+   * \brief Propagate a Cholesky factor S of the covariance, P = S S', instead of P.
+   * S is refreshed with a QR decomposition and rank-1 Cholesky updates and
+   * downdates, so no Cholesky factorization of P is needed at each step and
+   * P stays positive definite by construction.
+   * Must be called after InitSystem.
+   * If not called, the covariance itself is propagated.
+   * @param square_root True to enable the square-root form
+   */
+  void SetSquareRoot(bool square_root);
+
+  /*!
+   * \brief Declare that f is linear (or affine) in x, f(x, u) = F x + g(u).
+   * The time update is then the exact Kalman one, with a single call to f
+   * for the mean and no sigma point propagated through f.
+   * Must be called after InitSystem.
+   * @param F Matrix of the linear part of f
+   */
+  void SetLinearProcess(const mat& F);
+
+  /*!
+   * \brief Declare that h is linear (or affine) in x, h(x) = H x + c.
+   * The measurement update is then the exact Kalman one, with a single call
+   * to h for the mean and no sigma point projected through h.
+   * Must be called after InitSystem.
+   * @param H Matrix of the linear part of h
+   */
+  void SetLinearMeasurement(const mat& H);
+
+  /*!
+   * \brief Declare that f and h are reentrant and can be called concurrently.
+   * This is a contract from the user: f and h must not modify shared data.
+   * Without it, the sigma points are always propagated sequentially.
+   * @param thread_safe True if f and h can be called from several threads
+   */
+  void SetModelThreadSafe(bool thread_safe);
+
+  /*!
+   * \brief Propagate the sigma points through f and h in parallel.
+   * The sigma points are spread over a persistent thread pool, by the default
+   * f_batch and h_batch, and the results are written straight into the columns
+   * of the propagated sigma matrices.
+   * This pays off when f or h are expensive, and it only takes effect
+   * after SetModelThreadSafe(true).
+   * @param n_threads Number of threads, including the calling thread, 1 disables it
    */
-  void InitSystem(int n_states, int n_outputs, const mat& Q, const mat& R);
+  void SetSigmaPointThreads(int n_threads);
   /*!
    * \brief Define model of your system.
    * @param x System states
@@ -75,6 +163,44 @@ public:
    * @param x System states
    */
   virtual colvec h(const colvec &x);
+
+  /*!
+   * \brief Define model of your system, writing the result in place.
+   * Override this one instead of f(x, u) and no vector is returned by value:
+   * the filter always evaluates f through it. The default calls f(x, u).
+   * out is never x, and already has its size, out.set_size with that same
+   * size is allowed.
+   * @param x System states
+   * @param u System inputs
+   * @param out f(x, u), this is a returned value
+   */
+  virtual void f(const colvec &x, const colvec &u, colvec &out);
+
+  /*!
+   * \brief Define the output model of your system, writing the result in place.
+   * Same as f(x, u, out), the default calls h(x).
+   * @param x System states
+   * @param out h(x), this is a returned value
+   */
+  virtual void h(const colvec &x, colvec &out);
+
+  /*!
+   * \brief Evaluate f at several states in one call.
+   * The sigma points are propagated through this function. Override it to
+   * vectorize the model over the columns. The default calls f for each column,
+   * on the thread pool if SetModelThreadSafe(true) and SetSigmaPointThreads were called.
+   * @param X System states, one per column
+   * @param u System inputs
+   * @param Y f of each column of X, this is a returned value
+   */
+  virtual void f_batch(const mat &X, const colvec &u, mat &Y);
+
+  /*!
+   * \brief Evaluate h at several states in one call, see f_batch.
+   * @param X System states, one per column
+   * @param Y h of each column of X, this is a returned value
+   */
+  virtual void h_batch(const mat &X, mat &Y);
   /*!
    * \brief Initialize the system states.
    * Must be called after InitSystem.
@@ -134,15 +260,161 @@ public:
   */
   colvec* GetCurrentEstimatedOutput();
   
+  /*!
+   * @brief Get the log-likelihood of the last measurement.
+   * The density of the innovation under N(0, S), S being the innovation
+   * covariance, for model selection or multiple model filters.
+   * @return Log-likelihood of the last measurement
+   */
+  double GetLogLikelihood();
+  
+  /*!
+   * @brief Get the normalized innovation squared of the last measurement.
+   * Chi-square distributed with n_outputs degrees of freedom when the filter is consistent.
+   * @return innov' S^-1 innov
+   */
+  double GetNIS();
+  
+  /*!
+   * @brief Get the number of repairs of the covariance factor since InitSystem.
+   * A covariance that rounding made indefinite, or a downdate of the square-root
+   * form that would make it indefinite, is repaired by a full factorization,
+   * regularized if needed. A growing count points to a badly tuned or diverging filter.
+   * @return Number of repairs
+   */
+  int GetCovarianceRepairs();
+  
+  /*!
+   * @brief Use another generator for the noise of the simulated system.
+   * The filter does not own it, it must live as long as the filter simulates with it.
+   * @param generator Noise generator, 0 to go back to the own one of the filter
+   */
+  void SetNoiseGenerator(NoiseGenerator* generator);
+  
+  /*!
+   * @brief Get the generator of the noise of the simulated system, to seed it.
+   * @return The generator in use
+   */
+  NoiseGenerator* GetNoiseGenerator();
+  
 private:
+  /*!
+   * \brief Compute the unit sigma points and their weights, and size the buffers.
+   */
+  void InitSigmaPoints();
+
+  /*!
+   * \brief Lower triangular square root of a weighted sum of outer products plus a noise covariance.
+   * The deviations with a positive weight and the noise factor go through one
+   * QR decomposition, the ones with a negative weight are removed with downdates.
+   * @param dev Deviations from the mean, one per column
+   * @param noise_root Any square root N of the noise covariance, N N' is the covariance
+   * @param C Workspace for the compound matrix
+   * @param S Lower triangular factor, this is a returned value
+   */
+  void SquareRootFactor(const mat& dev, const mat& noise_root, mat& C, mat& S);
+
+  /*!
+   * \brief Lower triangular square root of M M' + noise_root noise_root', by QR.
+   * @param M Any matrix with n rows
+   * @param noise_root Any square root N of the noise covariance, N N' is the covariance, n x n
+   * @param C Workspace for the compound matrix
+   * @param S Lower triangular factor, this is a returned value
+   */
+  void LinearSquareRootFactor(const mat& M, const mat& noise_root, mat& C, mat& S);
+
+  /*!
+   * \brief QR decomposition of C, giving the lower triangular factor of C' C.
+   * Householder reflections applied in place, only R is formed.
+   * @param C Compound matrix, overwritten
+   * @param S Lower triangular factor with a positive diagonal, this is a returned value
+   */
+  static void TriangularFactor(mat& C, mat& S);
+
+
+  /*!
+   * \brief Rank-1 update or downdate of a lower Cholesky factor, L L' + sign * x x'.
+   * @param L Lower triangular factor with a positive diagonal, this is a returned value
+   * @param x The vector, overwritten
+   * @param sign +1 for an update, -1 for a downdate
+   * @return False if a downdate would make the matrix indefinite, L is then partly updated
+   */
+  static bool CholUpdate(mat& L, colvec& x, double sign);
+
+  /*!
+   * \brief Lower Cholesky factor of a covariance, P = L L'.
+   * If P is not numerically positive definite, P + shift * I is factored
+   * instead, the shift doubled from sqrt(epsilon) times the mean diagonal of P
+   * until the factorization goes through.
+   * @param P Covariance
+   * @param L Lower triangular factor, this is a returned value, NaN if P is not finite
+   * @return False if P had to be shifted
+   */
+  static bool FactorCovariance(const mat& P, mat& L);
+
+  SigmaPointSet pointSet_; ///< The set of sigma points
+  double alpha_;   ///< Spread of the sigma points
+  double beta_;    ///< Prior knowledge of the distribution
+  double kappa_;   ///< Secondary scaling parameter
+
+  mat U_;          ///< Sigma points of a zero mean and unit covariance, one per column
+  colvec Wm_;      ///< Weights for the mean, one per sigma point
+  rowvec Wc_;      ///< Weights for the covariance, one per sigma point
+
+  mat A_;          ///< Lower Cholesky factor of the covariance
+  mat X_;          ///< Sigma points, one per column
+  mat X_post_;     ///< Sigma points propagated through f
+  mat Y_post_;     ///< Propagated sigma points, projected through h
+  mat dX_;         ///< Deviations of X_post_ from the predicted state
+  mat dY_;         ///< Deviations of Y_post_ from the predicted output
+  mat dXw_;        ///< dX_, with each column scaled by its covariance weight
+  mat dYw_;        ///< dY_, with each column scaled by its covariance weight
+  mat dXt_;        ///< Transpose of dX_
+  mat dYt_;        ///< Transpose of dY_
+
+  colvec x_pre_;   ///< Predicted state
+  colvec y_pre_;   ///< Predicted output
+  colvec innov_;   ///< Innovation
+  colvec xw_;      ///< Next simulated state
+  mat Pxx_;        ///< Predicted state covariance
+  mat Pyy_;        ///< Predicted output covariance
+  mat Pxy_;        ///< Cross covariance
+  InnovationFactor<eT> factor_; ///< Cholesky factor of Pyy_
+  mat K_;          ///< Kalman gain
+
+  bool squareRoot_; ///< True if S_ is propagated instead of P_
+  mat S_;          ///< Lower Cholesky factor of the covariance, square-root form
+  mat Sy_;         ///< Lower Cholesky factor of Pyy_, square-root form
+  mat Cx_;         ///< Transposed compound matrix of the time update, decomposed by QR
+  mat Cy_;         ///< Transposed compound matrix of the measurement update, decomposed by QR
+  colvec dev_;     ///< Workspace for the rank-1 updates
+  mat Sp_;         ///< S_ before the measurement downdates, to repair a failed one
+  int repairs_;    ///< Number of repairs of the covariance factor
+
+  bool linearProcess_;     ///< True if f is declared linear
+  bool linearMeasurement_; ///< True if h is declared linear
+  mat F_;          ///< Matrix of the linear f
+  mat H_;          ///< Matrix of the linear h
+  mat FP_;         ///< F_ * P_
+  mat FS_;         ///< F_ * S_
+  mat HS_;         ///< H_ * S_
+  mat Ft_;         ///< Transpose of F_
+  mat Ht_;         ///< Transpose of H_
+  mat HSt_;        ///< Transpose of HS_
+
+  ThreadPool pool_;      ///< Workers for the parallel propagation
+  bool modelThreadSafe_; ///< True if f and h can be called concurrently
 
   mat Q_;          ///< Process noise covariance
   mat R_;          ///< Measurement noise covariance
   colvec v_;       ///< Gaussian process noise
   colvec w_;       ///< Gaussian measurement noise
   
-  mat sqrt_Q_;     ///< Process noise standard deviation
-  mat sqrt_R_;     ///< Measurement noise standard deviation
+  mat sqrt_Q_;     ///< Lower Cholesky factor of Q, for the process noise sqrt_Q_ v_ and the square-root form
+  mat sqrt_R_;     ///< Lower Cholesky factor of R, for the measurement noise sqrt_R_ w_ and the square-root form
+  
+  NoiseGenerator noise_;            ///< Own generator of the noise
+  NoiseGenerator* noiseGenerator_;  ///< Generator in use, 0 for noise_
   
   mat P_;          ///< Covariance matrix
   colvec x_m_;     ///< Estimated states
@@ -150,6 +422,12 @@ private:
 
 protected:
   
+  /*!
+   * \brief Thread pool for the batches of model evaluations.
+   * @return The pool, or 0 if the model is evaluated sequentially
+   */
+  ThreadPool* ModelPool();
+  
   int nStates_;   ///< Number of the states
   int nOutputs_;  ///< Number of outputs
   
@@ -157,5 +435,63 @@ protected:
   colvec z_;      ///< Output matrix, by simulation, true value
 };
 
+/// The unscented Kalman filter in double precision
+typedef BasicUKF<double> UKF;
+
+/// The unscented Kalman filter in single precision
+typedef BasicUKF<float> fUKF;
+
+/*!
+ * @brief The unscented Kalman filter with the model bound at compile time.
+ * Derive MyModel from UKFT<MyModel> instead of UKF, and define f and h in it
+ * with the same signatures, returning the result or writing it in place. The
+ * batches of model evaluations then call MyModel::f and MyModel::h without
+ * virtual dispatch, so the compiler can inline them into the sigma point propagation.
+ * \code
+ * class MyModel : public UKFT<MyModel> {
+ * public:
+ *  colvec f(const colvec &x, const colvec &u) { ... }
+ *  colvec h(const colvec &x) { ... }
+ * };
+ * \endcode
+ * The element type eT is double by default, see BasicUKF.
+ * The single evaluations of a step still go through the virtual functions.
+ */
+template <class Model, class eT = double>
+class UKFT : public BasicUKF<eT> {
+public:
+  typedef typename BasicUKF<eT>::mat mat;
+  typedef typename BasicUKF<eT>::colvec colvec;
+
+  /*!
+   * \brief Evaluate Model::f at several states, see BasicUKF::f_batch.
+   * @param X System states, one per column
+   * @param u System inputs
+   * @param Y f of each column of X, this is a returned value
+   */
+  virtual void f_batch(const mat &X, const colvec &u, mat &Y) {
+    Model &model = static_cast<Model&>(*this);
+    Y.set_size(this->nStates_, X.n_cols);
+    ForEachColumn(this->ModelPool(), X, [&](uword k, const colvec &x_k) {
+      colvec y_k(Y.colptr(k), Y.n_rows, false, true);
+      CallModelF(model, x_k, u, y_k, 0);
+    });
+  }
+
+  /*!
+   * \brief Evaluate Model::h at several states, see BasicUKF::h_batch.
+   * @param X System states, one per column
+   * @param Y h of each column of X, this is a returned value
+   */
+  virtual void h_batch(const mat &X, mat &Y) {
+    Model &model = static_cast<Model&>(*this);
+    Y.set_size(this->nOutputs_, X.n_cols);
+    ForEachColumn(this->ModelPool(), X, [&](uword k, const colvec &x_k) {
+      colvec y_k(Y.colptr(k), Y.n_rows, false, true);
+      CallModelH(model, x_k, y_k, 0);
+    });
+  }
+};
+
 
 #endif
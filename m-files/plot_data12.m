@@ -0,0 +1,34 @@
+close all;
+clear all;
+load ../bin/log_file12.txt;
+
+% This is the data format:
+% iteration# [TAB] true1 [TAB] estimate1 [TAB] 
+% true2 [TAB] estimate2 [TAB]
+% measurement [TAB] estimate [EOL]
+
+figure;
+
+subplot(2, 1, 1);
+hold on;
+plot(log_file12(:,1), log_file12(:,2), 'b');
+plot(log_file12(:,1), log_file12(:,3), '--r');
+ylabel('x_1');
+
+subplot(2, 1, 2);
+hold on;
+plot(log_file12(:,1), log_file12(:,4), 'b');
+plot(log_file12(:,1), log_file12(:,5), '--r');
+xlabel('n-th iteration');
+ylabel('x_2');
+
+legend('true', 'estimate');
+
+figure
+hold on;
+plot(log_file12(:,1), log_file12(:,6), 'b');
+plot(log_file12(:,1), log_file12(:,7), '--r');
+xlabel('n-th iteration');
+ylabel('z');
+
+legend('measurement', 'estimate');
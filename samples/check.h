@@ -0,0 +1,25 @@
+/**
+ * @file check.h
+ * @author agent
+ * @date 19 Oct 2026
+ *
+ * @brief The check shared by the samples that test the filters.
+ */
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+/// @cond DEV
+/*
+ * Print a value next to its bound, and tell whether it is within the bound.
+ */
+inline bool Check(const char* what, double value, double bound)
+{
+  printf("%-52s %10.3g, bound %8.3g\n", what, value, bound);
+  return value <= bound;
+}
+/// @endcond
+
+#endif
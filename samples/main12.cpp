@@ -0,0 +1,109 @@
+/**
+ * @file main12.cpp
+ * @author agent
+ * @date 18 Oct 2026
+ * 
+ * @brief Example for the continuous-discrete extended Kalman filter.
+ * 
+ * @section DESCRIPTION
+ * Tracking a Van der Pol oscillator, whose dynamics is given as an ODE.
+ * Only the position is measured. The integrator takes small steps where 
+ * the oscillator moves fast and large steps elsewhere.
+ */
+
+#include <fstream>
+#include <iostream>
+
+#include "cdekf.h"
+
+/// @cond DEV
+/*
+ * Class CDEKF needs to be derived, two virtual functions are provided in 
+ * which the time derivative of the system and output model are described.
+ */
+class MyCDEKF: public CDEKF
+{
+public:  
+  virtual colvec dfdt(const colvec& x, const colvec& u) {
+    colvec dx(nStates_);
+    dx(0) = x(1);
+    dx(1) = mu * (1 - x(0) * x(0)) * x(1) - x(0);
+    return dx;
+  }
+  
+  virtual colvec h(const colvec& x) {
+    colvec zk(nOutputs_);
+    zk(0) = x(0);
+    return zk;
+  }
+  
+  static const double mu;
+};
+
+const double MyCDEKF::mu = 5.0;
+
+/// @endcond
+
+/////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv)
+{
+  /* 
+   * Log the result into a tab delimitted file, later we can open 
+   * it with Matlab. Use: plot_data12.m to plot the results.
+   */
+  ofstream log_file;
+#ifdef _WIN32
+  log_file.open("..\\bin\\log_file12.txt");
+#else
+  log_file.open("log_file12.txt");
+#endif
+  
+  int n_states = 2;
+  int n_outputs = 1;
+  double dt = 0.1;
+  
+  mat Qc(n_states, n_states);
+  mat R(n_outputs, n_outputs);
+  
+  Qc << 0 << 0    << endr
+     << 0 << 0.01 << endr;
+    
+  R << 0.05 << endr;
+  
+  colvec x0(n_states);
+  x0 << 2 << 0;
+  
+  colvec u;
+
+  // No inputs
+  u = u.zeros(); 
+ 
+  MyCDEKF mycdekf;
+  mycdekf.InitSystem(n_states, n_outputs, Qc, R, dt);
+  mycdekf.InitSystemState(x0);
+  mycdekf.SetTolerance(1e-6, 1e-8);
+  
+  int n_steps = 0;
+  
+  for (int k = 0; k < 200; k ++) {
+    mycdekf.EKalmanf(u);
+    n_steps += mycdekf.GetIntegrationSteps();
+    
+    colvec *x = mycdekf.GetCurrentState();
+    colvec *x_m = mycdekf.GetCurrentEstimatedState();
+    colvec *z = mycdekf.GetCurrentOutput();
+    colvec *z_m = mycdekf.GetCurrentEstimatedOutput();
+    
+    log_file << k << '\t' << x->at(0,0) << '\t' << x_m->at(0,0)  
+                  << '\t' << x->at(1,0) << '\t' << x_m->at(1,0)
+                  << '\t' << z->at(0,0) << '\t' << z_m->at(0,0) << '\t' 
+                  << '\n'; 
+  }
+  
+  cout << "Integration steps per prior update: " << n_steps / 200.0 << endl;
+  
+  log_file.close();
+  
+  return 0;
+}
@@ -0,0 +1,255 @@
+/**
+ * @file main13.cpp
+ * @author agent
+ * @date 18 Oct 2026
+ *
+ * @brief Benchmark of the filters in single and double precision.
+ *
+ * @section DESCRIPTION
+ * The same measurements are filtered by KF, EKF, EKF2 and UKF and by their
+ * single precision versions fKF, fEKF, fEKF2 and fUKF. The nonlinear filters
+ * track the random sine signal of the samples 6, 8 and 11. The linear one
+ * tracks 64 independent position/velocity channels at once, the largest of
+ * the systems and the one dominated by memory traffic. For each filter, the
+ * time per step and the RMS error of the estimated positions against the
+ * true ones are printed, for both precisions. The program returns 1 if the
+ * error of a single precision filter is not within 10% of the error of its
+ * double precision version, or is not finite.
+ *
+ * The times only compare the precisions in an optimized build, -O2 or more.
+ * Without optimization the overhead of the calls hides the arithmetic and both
+ * precisions take the same time. The CMake build is a debug one by default,
+ * configure it with -DCMAKE_BUILD_TYPE=Release for the timings.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <stdio.h>
+
+#include "kf.h"
+#include "ekf.h"
+#include "ekf2.h"
+#include "ukf.h"
+
+/// @cond DEV
+/*
+ * One model for all the filters and both precisions: inside the filters,
+ * mat and colvec are of the element type of the filter.
+ */
+template <class Filter>
+class SineTracker: public Filter
+{
+public:
+  typedef typename Filter::colvec colvec;
+
+  virtual colvec f(const colvec& x, const colvec& u) {
+    colvec xk(3);
+    xk(0) = x(0) + dt * x(1);
+    xk(1) = x(1);
+    xk(2) = x(2);
+    return xk;
+  }
+
+  virtual colvec h(const colvec& x) {
+    colvec zk(1);
+    zk(0) = x(2) * sin(x(0));
+    return zk;
+  }
+
+  static const double dt;
+};
+
+template <class Filter>
+const double SineTracker<Filter>::dt = 0.01;
+
+/*
+ * Time the steps of a filter, in microseconds per step.
+ */
+template <class Step>
+double TimeSteps(Step step, int n_steps)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (int k = 0; k < n_steps; k++)
+    step(k);
+  std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / n_steps;
+}
+
+/*
+ * Filter the sine measurements with a nonlinear filter of element type eT.
+ * X receives the estimated states, in double precision.
+ */
+template <class eT, class Filter>
+double TrackSine(Filter& kalman, const mat& Z, mat& X)
+{
+  Mat<eT> Q(3, 3, fill::zeros), R(1, 1);
+  Q(1, 1) = 0.2 * 0.01;
+  Q(2, 2) = 0.1 * 0.01;
+  R(0, 0) = 0.1;
+
+  Col<eT> x0(3), u(1, fill::zeros), z(1);
+  x0(0) = 0;
+  x0(1) = 10;
+  x0(2) = 1;
+
+  kalman.InitSystem(3, 1, Q, R);
+  kalman.InitSystemState(x0);
+
+  X.set_size(3, Z.n_cols);
+  return TimeSteps([&](int k) {
+    z(0) = (eT)Z(0, k);
+    kalman.EKalmanf(z, u);
+    X.col(k) = conv_to<colvec>::from(*kalman.GetCurrentEstimatedState());
+  }, Z.n_cols);
+}
+
+/*
+ * Same for the UKF, with the cubature points, which have no small alpha
+ * whose weights would cancel out in single precision.
+ */
+template <class eT, class Filter>
+double TrackSineUKF(Filter& kalman, const mat& Z, mat& X)
+{
+  Mat<eT> Q(3, 3, fill::zeros), R(1, 1);
+  Q(1, 1) = 0.2 * 0.01;
+  Q(2, 2) = 0.1 * 0.01;
+  R(0, 0) = 0.1;
+
+  Col<eT> x0(3), u(1, fill::zeros), z(1);
+  x0(0) = 0;
+  x0(1) = 10;
+  x0(2) = 1;
+
+  kalman.InitSystem(3, 1, Q, R);
+  kalman.SetSigmaPoints(Filter::CUBATURE);
+  kalman.InitSystemState(x0);
+
+  X.set_size(3, Z.n_cols);
+  return TimeSteps([&](int k) {
+    z(0) = (eT)Z(0, k);
+    kalman.UKalmanf(z, u);
+    X.col(k) = conv_to<colvec>::from(*kalman.GetCurrentEstimatedState());
+  }, Z.n_cols);
+}
+
+/*
+ * Filter the positions of n_channels position/velocity channels with a KF of element type eT.
+ */
+template <class eT>
+double TrackChannels(BasicKF<eT>& kalman, const mat& Z, mat& X)
+{
+  int n_channels = Z.n_rows;
+  Mat<eT> A(2 * n_channels, 2 * n_channels, fill::eye);
+  Mat<eT> B(2 * n_channels, 1, fill::zeros);
+  Mat<eT> H(n_channels, 2 * n_channels, fill::zeros);
+  Mat<eT> Q(2 * n_channels, 2 * n_channels, fill::zeros);
+  Mat<eT> R(n_channels, n_channels, fill::eye);
+
+  for (int c = 0; c < n_channels; c++) {
+    A(2 * c, 2 * c + 1) = 0.01;
+    H(c, 2 * c) = 1;
+    Q(2 * c + 1, 2 * c + 1) = 0.01;
+  }
+  R = R * 0.25;
+
+  Col<eT> u(1, fill::zeros);
+  kalman.InitSystem(A, B, H, Q, R);
+
+  X.set_size(2 * n_channels, Z.n_cols);
+  return TimeSteps([&](int k) {
+    Col<eT> z = conv_to< Col<eT> >::from(Z.col(k));
+    kalman.Kalmanf(z, u);
+    X.col(k) = conv_to<colvec>::from(*kalman.GetCurrentEstimatedState());
+  }, Z.n_cols);
+}
+
+/*
+ * Print the times and the errors of a filter. False if an error is not finite,
+ * or if the single precision error is more than 10% above the double precision one.
+ */
+bool PrintRow(const char* name, double t_double, double t_float, const mat& X_true,
+  const mat& X_double, const mat& X_float)
+{
+  double e_double = sqrt(accu(square(X_double - X_true)) / X_true.n_elem);
+  double e_float = sqrt(accu(square(X_float - X_true)) / X_true.n_elem);
+  printf("%-6s %12.2f %12.2f %14.4f %14.4f\n", name, t_double, t_float, e_double, e_float);
+  return std::isfinite(e_double) && std::isfinite(e_float) && e_float <= 1.1 * e_double;
+}
+
+/*
+ * The position of the sine signal, from its estimated states.
+ */
+mat SinePosition(const mat& X)
+{
+  return X.row(2) % sin(X.row(0));
+}
+
+/// @endcond
+
+/////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv)
+{
+  const int n_steps = 5000;
+  const int n_channels = 64;
+
+  /*
+   * Measurements of the random sine signal, and of the channels
+   */
+  arma_rng::set_seed(1);
+  mat Z(1, n_steps), X_true(1, n_steps);
+  colvec x(3);
+  x << 0 << 10 << 1;
+  for (int k = 0; k < n_steps; k++) {
+    x(0) = x(0) + 0.01 * x(1);
+    x(1) = x(1) + sqrt(0.2 * 0.01) * randn();
+    x(2) = x(2) + sqrt(0.1 * 0.01) * randn();
+    X_true(0, k) = x(2) * sin(x(0));
+    Z(0, k) = X_true(0, k) + sqrt(0.1) * randn();
+  }
+
+  mat Z_channels(n_channels, n_steps / 50), P_true(n_channels, n_steps / 50);
+  colvec p = randn<colvec>(n_channels), v = randn<colvec>(n_channels);
+  for (uword k = 0; k < Z_channels.n_cols; k++) {
+    p = p + 0.01 * v;
+    v = v + 0.1 * randn<colvec>(n_channels);
+    P_true.col(k) = p;
+    Z_channels.col(k) = p + 0.5 * randn<colvec>(n_channels);
+  }
+
+  mat X_double, X_float;
+  double t_double, t_float;
+  bool ok = true;
+
+#if !defined(__OPTIMIZE__) && !defined(NDEBUG)
+  printf("Built without optimization, the times do not compare the precisions\n");
+#endif
+  printf("%-6s %12s %12s %14s %14s\n", "filter", "double [us]", "float [us]", "double error", "float error");
+
+  KF kf;
+  fKF kf_float;
+  t_double = TrackChannels(kf, Z_channels, X_double);
+  t_float = TrackChannels(kf_float, Z_channels, X_float);
+  uvec positions = regspace<uvec>(0, 2, 2 * n_channels - 1);
+  ok = PrintRow("KF", t_double, t_float, P_true, X_double.rows(positions), X_float.rows(positions)) && ok;
+
+  SineTracker<EKF> ekf;
+  SineTracker<fEKF> ekf_float;
+  t_double = TrackSine<double>(ekf, Z, X_double);
+  t_float = TrackSine<float>(ekf_float, Z, X_float);
+  ok = PrintRow("EKF", t_double, t_float, X_true, SinePosition(X_double), SinePosition(X_float)) && ok;
+
+  SineTracker<EKF2> ekf2;
+  SineTracker<fEKF2> ekf2_float;
+  t_double = TrackSine<double>(ekf2, Z, X_double);
+  t_float = TrackSine<float>(ekf2_float, Z, X_float);
+  ok = PrintRow("EKF2", t_double, t_float, X_true, SinePosition(X_double), SinePosition(X_float)) && ok;
+
+  SineTracker<UKF> ukf;
+  SineTracker<fUKF> ukf_float;
+  t_double = TrackSineUKF<double>(ukf, Z, X_double);
+  t_float = TrackSineUKF<float>(ukf_float, Z, X_float);
+  ok = PrintRow("UKF", t_double, t_float, X_true, SinePosition(X_double), SinePosition(X_float)) && ok;
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+/**
+ * @file main14.cpp
+ * @author agent
+ * @date 18 Oct 2026
+ *
+ * @brief Count the heap allocations of a filter step.
+ *
+ * @section DESCRIPTION
+ * The filters keep their workspace from InitSystem on, so once warmed up a
+ * step should not allocate anything. Here the allocator of the C library is
+ * hooked and the allocations are counted for KF, EKF, EKF2, UKF and the
+ * square-root UKF, over many steps after a few warm-up ones. The model is
+ * written with the in-place f and h, so it does not allocate either, and
+ * the whole step is counted. The program returns 1 if any filter allocates
+ * in its steps.
+ * The hooks need glibc, elsewhere the counts are not available.
+ */
+
+#include <stdio.h>
+
+#include "kf.h"
+#include "ekf.h"
+#include "ekf2.h"
+#include "ukf.h"
+
+/// @cond DEV
+#if defined(__GLIBC__)
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t n, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void* __libc_memalign(size_t alignment, size_t size);
+
+static bool counting = false;
+static long n_allocs = 0;
+
+/*
+ * All the allocators of the program go through these, Armadillo uses posix_memalign.
+ */
+extern "C" void* malloc(size_t size)
+{
+  n_allocs += counting;
+  return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t n, size_t size)
+{
+  n_allocs += counting;
+  return __libc_calloc(n, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size)
+{
+  n_allocs += counting;
+  return __libc_realloc(ptr, size);
+}
+
+extern "C" int posix_memalign(void** ptr, size_t alignment, size_t size)
+{
+  n_allocs += counting;
+  *ptr = __libc_memalign(alignment, size);
+  return (*ptr) ? 0 : 12; // ENOMEM
+}
+
+#define ALLOCATION_COUNT_AVAILABLE 1
+#else
+static bool counting = false;
+static long n_allocs = 0;
+#define ALLOCATION_COUNT_AVAILABLE 0
+#endif
+
+/*
+ * A target moving in 3D, seen by its range and bearing. The results are
+ * written into the vectors given by the filter.
+ */
+template <class Filter>
+class Target : public Filter
+{
+public:
+  virtual void f(const colvec& x, const colvec& u, colvec& xk) {
+    xk.set_size(6);
+    for (int i = 0; i < 3; i++) {
+      xk(i) = x(i) + 0.1 * x(i + 3);
+      xk(i + 3) = x(i + 3);
+    }
+    xk(3) = xk(3) - 0.01 * sin(x(0));
+  }
+
+  virtual void h(const colvec& x, colvec& zk) {
+    zk.set_size(2);
+    zk(0) = sqrt(x(0) * x(0) + x(1) * x(1) + x(2) * x(2));
+    zk(1) = atan2(x(1), x(0));
+  }
+};
+
+/*
+ * Allocations per step of a filter, after a few warm-up steps.
+ */
+template <class Step>
+double CountAllocations(Step step)
+{
+  const int n_warmup = 3;
+  const int n_steps = 100;
+
+  for (int k = 0; k < n_warmup; k++)
+    step();
+
+  n_allocs = 0;
+  counting = true;
+  for (int k = 0; k < n_steps; k++)
+    step();
+  counting = false;
+
+  return (double)n_allocs / n_steps;
+}
+
+/// @endcond
+
+/////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv)
+{
+  if (!ALLOCATION_COUNT_AVAILABLE) {
+    printf("Counting the allocations needs glibc\n");
+    return 0;
+  }
+
+  colvec x0(6), u(1, fill::zeros), z(2);
+  x0 << 1 << 0.5 << 2 << 0.1 << 0.1 << 0.1;
+  z << 2.3 << 0.45;
+
+  mat Q = 0.01 * eye(6, 6);
+  mat R = 0.01 * eye(2, 2);
+
+  // The linear filter sees the first two positions
+  mat A = eye(6, 6);
+  A.submat(0, 3, 2, 5) = 0.1 * eye(3, 3);
+  mat B(6, 1, fill::zeros);
+  mat H(2, 6, fill::zeros);
+  H(0, 0) = 1;
+  H(1, 1) = 1;
+
+  KF kf;
+  kf.InitSystem(A, B, H, Q, R);
+  kf.InitSystemState(x0);
+
+  Target<EKF> ekf;
+  ekf.InitSystem(6, 2, Q, R);
+  ekf.InitSystemState(x0);
+
+  Target<EKF2> ekf2;
+  ekf2.InitSystem(6, 2, Q, R);
+  ekf2.InitSystemState(x0);
+
+  Target<UKF> ukf;
+  ukf.InitSystem(6, 2, Q, R);
+  ukf.InitSystemState(x0);
+
+  Target<UKF> srukf;
+  srukf.InitSystem(6, 2, Q, R);
+  srukf.SetSquareRoot(true);
+  srukf.InitSystemState(x0);
+
+  double allocs[5];
+  allocs[0] = CountAllocations([&]() { kf.Kalmanf(z, u); });
+  allocs[1] = CountAllocations([&]() { ekf.EKalmanf(z, u); });
+  allocs[2] = CountAllocations([&]() { ekf2.EKalmanf(z, u); });
+  allocs[3] = CountAllocations([&]() { ukf.UKalmanf(z, u); });
+  allocs[4] = CountAllocations([&]() { srukf.UKalmanf(z, u); });
+
+  const char* names[5] = { "KF", "EKF", "EKF2", "UKF", "SR-UKF" };
+  bool ok = true;
+  for (int i = 0; i < 5; i++) {
+    printf("%-8s %g allocations per step\n", names[i], allocs[i]);
+    ok = ok && (allocs[i] == 0);
+  }
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+/**
+ * @file main15.cpp
+ * @author agent
+ * @date 18 Oct 2026
+ *
+ * @brief Compare the kernels of the small matrix operations.
+ *
+ * @section DESCRIPTION
+ * The same measurements are filtered with each set of kernels the processor
+ * supports: the plain loops, AVX2 and AVX-512. The KF tracks four targets in
+ * the plane, 16 states and 8 outputs, the largest size the kernels take. The
+ * EKF and the UKF track one target in 3D from its range, azimuth and elevation,
+ * 6 states.
+ * For each set, the time per step of each filter is printed, and the largest
+ * difference of the estimates to the ones of the scalar kernels, relative to
+ * the largest estimate. The differences are from the rounding only, the
+ * EKF amplifies them the most with its finite difference Jacobians.
+ */
+
+#include <chrono>
+#include <stdio.h>
+
+#include "kf.h"
+#include "ekf.h"
+#include "ukf.h"
+
+/// @cond DEV
+/*
+ * A target moving in 3D, seen by its range, azimuth and elevation.
+ */
+template <class Filter>
+class Target : public Filter
+{
+public:
+  virtual colvec f(const colvec& x, const colvec& u) {
+    colvec xk(6);
+    for (int i = 0; i < 3; i++) {
+      xk(i) = x(i) + 0.1 * x(i + 3);
+      xk(i + 3) = x(i + 3);
+    }
+    xk(3) = xk(3) - 0.01 * sin(x(0));
+    return xk;
+  }
+
+  virtual colvec h(const colvec& x) {
+    colvec zk(3);
+    zk(0) = sqrt(x(0) * x(0) + x(1) * x(1) + x(2) * x(2));
+    zk(1) = atan2(x(1), x(0));
+    zk(2) = atan2(x(2), sqrt(x(0) * x(0) + x(1) * x(1)));
+    return zk;
+  }
+};
+
+/*
+ * Time the steps of a filter, in microseconds per step. X receives the estimated states.
+ */
+template <class Step>
+double TimeSteps(Step step, const mat& Z, mat& X)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (uword k = 0; k < Z.n_cols; k++)
+    X.col(k) = step(Z.col(k));
+  std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / Z.n_cols;
+}
+
+/*
+ * Largest difference of the estimates X to the reference ones, relative to the largest of them.
+ */
+double RelativeDifference(const mat& X, const mat& X_ref)
+{
+  return abs(X - X_ref).max() / abs(X_ref).max();
+}
+/// @endcond
+
+/////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv)
+{
+  const int n_steps = 5000;
+  const int n_targets = 4;
+
+  /*
+   * The four targets of the KF, positions and velocities in the plane
+   */
+  int n = 4 * n_targets, m = 2 * n_targets;
+  mat A = eye(n, n), B(n, 1, fill::zeros), H(m, n, fill::zeros);
+  for (int i = 0; i < m; i++) {
+    A(i, m + i) = 0.1;
+    H(i, i) = 1;
+  }
+  mat Q = 0.01 * eye(n, n), R = 0.25 * eye(m, m);
+
+  arma_rng::set_seed(1);
+  mat Z_kf(m, n_steps);
+  colvec x = randn<colvec>(n);
+  for (int k = 0; k < n_steps; k++) {
+    x = A * x + 0.1 * randn<colvec>(n);
+    Z_kf.col(k) = H * x + 0.5 * randn<colvec>(m);
+  }
+
+  /*
+   * The 3D target of the EKF and the UKF
+   */
+  mat Q6 = 0.0001 * eye(6, 6), R3 = 0.0001 * eye(3, 3);
+  colvec x0(6);
+  x0 << 1 << 0.5 << 2 << 0.1 << 0.1 << 0.1;
+
+  Target<EKF> model;
+  model.InitSystem(6, 3, Q6, R3);
+  model.InitSystemState(x0);
+  mat Z_3d(3, n_steps);
+  for (int k = 0; k < n_steps; k++) {
+    model.EKalmanf(colvec(1, fill::zeros));
+    Z_3d.col(k) = *model.GetCurrentOutput();
+  }
+
+  SmallMat::InstructionSet sets[3] = { SmallMat::SCALAR, SmallMat::AVX2, SmallMat::AVX512 };
+  mat X_kf[3], X_ekf[3], X_ukf[3];
+  colvec u(1, fill::zeros);
+
+  printf("%-8s %10s %10s %10s %12s\n", "kernels", "KF [us]", "EKF [us]", "UKF [us]", "difference");
+  for (int s = 0; s < 3; s++) {
+    if (!SmallMat::SetInstructionSet(sets[s])) {
+      printf("%-8s not supported here\n", s == 1 ? "AVX2" : "AVX-512");
+      continue;
+    }
+
+    KF kf;
+    kf.InitSystem(A, B, H, Q, R);
+    X_kf[s].set_size(n, n_steps);
+    double t_kf = TimeSteps([&](const colvec& z) {
+      kf.Kalmanf(z, u);
+      return *kf.GetCurrentEstimatedState();
+    }, Z_kf, X_kf[s]);
+
+    Target<EKF> ekf;
+    ekf.InitSystem(6, 3, Q6, R3);
+    ekf.InitSystemState(x0);
+    X_ekf[s].set_size(6, n_steps);
+    double t_ekf = TimeSteps([&](const colvec& z) {
+      ekf.EKalmanf(z, u);
+      return *ekf.GetCurrentEstimatedState();
+    }, Z_3d, X_ekf[s]);
+
+    Target<UKF> ukf;
+    ukf.InitSystem(6, 3, Q6, R3);
+    ukf.InitSystemState(x0);
+    X_ukf[s].set_size(6, n_steps);
+    double t_ukf = TimeSteps([&](const colvec& z) {
+      ukf.UKalmanf(z, u);
+      return *ukf.GetCurrentEstimatedState();
+    }, Z_3d, X_ukf[s]);
+
+    double difference = max(max(RelativeDifference(X_kf[s], X_kf[0]), RelativeDifference(X_ekf[s], X_ekf[0])),
+      RelativeDifference(X_ukf[s], X_ukf[0]));
+    printf("%-8s %10.2f %10.2f %10.2f %12.3g\n", SmallMat::GetInstructionSet(), t_kf, t_ekf, t_ukf, difference);
+  }
+
+  SmallMat::SetInstructionSet(SmallMat::AUTO);
+  return 0;
+}
@@ -0,0 +1,235 @@
+/**
+ * @file main16.cpp
+ * @author agent
+ * @date 19 Oct 2026
+ *
+ * @brief Check the precomputed Jacobian tables against the computed Jacobians.
+ *
+ * @section DESCRIPTION
+ * A vehicle drives a circle at a constant speed, seen by its range and bearing
+ * from the origin. The Jacobian of f only depends on the heading and the
+ * speed, the one of h on the position, so both are tabulated over these
+ * components by the filter, saved to a file and read back.
+ * The program returns 1 if one of these checks fails:
+ * - at the grid nodes, the tables hold the analytic Jacobians, up to the
+ *   finite differences,
+ * - in between, the interpolation stays within the error bound of the
+ *   multilinear interpolation,
+ * - the table read back interpolates exactly like the saved one,
+ * - the filter with the tables follows the filter computing its Jacobians,
+ * - a table of the wrong size, a truncated file and a NaN state are rejected.
+ */
+
+#include <stdio.h>
+#include <vector>
+
+#include "ekf.h"
+#include "check.h"
+
+/// @cond DEV
+/*
+ * States are the position, the heading and the speed, the input is the yaw rate.
+ */
+class Vehicle: public EKF
+{
+public:
+  virtual colvec f(const colvec& x, const colvec& u) {
+    colvec xk(4);
+    xk(0) = x(0) + dt * x(3) * cos(x(2));
+    xk(1) = x(1) + dt * x(3) * sin(x(2));
+    xk(2) = x(2) + dt * u(0);
+    xk(3) = x(3);
+    return xk;
+  }
+
+  virtual colvec h(const colvec& x) {
+    colvec zk(2);
+    zk(0) = sqrt(x(0) * x(0) + x(1) * x(1));
+    zk(1) = atan2(x(1), x(0));
+    return zk;
+  }
+
+  static mat JacobianF(const colvec& x) {
+    mat F = eye(4, 4);
+    F(0, 2) = -dt * x(3) * sin(x(2));
+    F(0, 3) = dt * cos(x(2));
+    F(1, 2) = dt * x(3) * cos(x(2));
+    F(1, 3) = dt * sin(x(2));
+    return F;
+  }
+
+  static mat JacobianH(const colvec& x) {
+    double r2 = x(0) * x(0) + x(1) * x(1);
+    mat H(2, 4, fill::zeros);
+    H(0, 0) = x(0) / sqrt(r2);
+    H(0, 1) = x(1) / sqrt(r2);
+    H(1, 0) = -x(1) / r2;
+    H(1, 1) = x(0) / r2;
+    return H;
+  }
+
+  static const double dt;
+};
+
+const double Vehicle::dt = 0.1;
+
+/*
+ * Largest difference of the interpolated Jacobians to the analytic ones, at the
+ * nodes or at random states inside the envelope.
+ */
+template <class Jacobian>
+double MaxError(const JacobianTable& table, Jacobian jacobian, const colvec& x_nominal,
+    const uvec& components, const colvec& lower, const colvec& upper, bool at_nodes)
+{
+  double e = 0;
+  mat J;
+  for (int k = 0; k < table.GetNumberOfNodes(); k++) {
+    colvec x = table.GetNode(k, x_nominal);
+    if (!at_nodes) {
+      for (uword a = 0; a < components.n_elem; a++)
+        x(components(a)) = lower(a) + (upper(a) - lower(a)) * randu();
+    }
+    table.Lookup(x, J);
+    e = max(e, (double)abs(J - jacobian(x)).max());
+  }
+  return e;
+}
+
+/*
+ * Cut the last bytes of a file.
+ */
+bool Truncate(const char* file_name, size_t n_cut)
+{
+  FILE* file = fopen(file_name, "rb");
+  if (!file)
+    return false;
+  std::vector<char> bytes;
+  char c[256];
+  size_t n;
+  while ((n = fread(c, 1, sizeof(c), file)) > 0)
+    bytes.insert(bytes.end(), c, c + n);
+  fclose(file);
+
+  file = fopen(file_name, "wb");
+  if (!file || bytes.size() < n_cut)
+    return false;
+  bool ok = fwrite(bytes.data(), 1, bytes.size() - n_cut, file) == bytes.size() - n_cut;
+  fclose(file);
+  return ok;
+}
+
+/// @endcond
+
+/////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv)
+{
+  mat Q = diagmat(colvec({ 1e-4, 1e-4, 1e-4, 1e-3 }));
+  mat R = diagmat(colvec({ 0.25, 1e-4 }));
+
+  // A circle of radius 20 m around (45, 45)
+  colvec x0({ 65, 45, M_PI / 2, 4 });
+  colvec u(1);
+  u(0) = 0.2;
+  const int n_steps = 150;
+
+  // f is tabulated over the heading and the speed, h over the position
+  uvec f_components({ 2, 3 });
+  colvec f_lower({ 0, 0 }), f_upper({ 6, 10 });
+  uvec f_points({ 121, 3 });
+  uvec h_components({ 0, 1 });
+  colvec h_lower({ 20, 20 }), h_upper({ 70, 70 });
+  uvec h_points({ 51, 51 });
+
+  Vehicle computed;
+  computed.InitSystem(4, 2, Q, R);
+
+  JacobianTable f_table, h_table;
+  f_table.InitGrid(f_components, f_lower, f_upper, f_points, 4, 4);
+  h_table.InitGrid(h_components, h_lower, h_upper, h_points, 2, 4);
+  computed.TabulateF(f_table, x0, u);
+  computed.TabulateH(h_table, x0);
+
+  bool ok = true;
+
+  // The finite differences of the filter are accurate to about sqrt(eps)
+  ok = Check("F at the nodes", MaxError(f_table, Vehicle::JacobianF, x0,
+      f_components, f_lower, f_upper, true), 1e-5) && ok;
+  ok = Check("H at the nodes", MaxError(h_table, Vehicle::JacobianH, x0,
+      h_components, h_lower, h_upper, true), 1e-5) && ok;
+
+  // Multilinear interpolation is off by at most step^2 / 8 times the second
+  // derivative. F is linear in the speed, its second derivative in the heading
+  // is dt * v at most. The one of H in the position is 2 / r^2 at most
+  arma_rng::set_seed(16);
+  double step_heading = (f_upper(0) - f_lower(0)) / (f_points(0) - 1);
+  double step_position = (h_upper(0) - h_lower(0)) / (h_points(0) - 1);
+  double r_min = sqrt(2.0) * h_lower(0);
+  ok = Check("F between the nodes", MaxError(f_table, Vehicle::JacobianF, x0,
+      f_components, f_lower, f_upper, false),
+      step_heading * step_heading / 8 * Vehicle::dt * f_upper(1) + 1e-5) && ok;
+  ok = Check("H between the nodes", MaxError(h_table, Vehicle::JacobianH, x0,
+      h_components, h_lower, h_upper, false),
+      2 * step_position * step_position / 8 * 2 / (r_min * r_min) + 1e-5) && ok;
+
+  // Round trip through a file
+  JacobianTable f_loaded, h_loaded;
+  bool saved = f_table.Save("jtable_f.bin") && h_table.Save("jtable_h.bin");
+  bool loaded = f_loaded.Load("jtable_f.bin") && h_loaded.Load("jtable_h.bin");
+  ok = Check("Save and Load failures", (!saved) + (!loaded), 0) && ok;
+
+  double e_loaded = 0;
+  mat J1, J2;
+  for (int k = 0; k < 1000; k++) {
+    colvec x({ 10 + 70 * randu(), 10 + 70 * randu(), 7 * randu() - 0.5, 12 * randu() - 1 });
+    f_table.Lookup(x, J1);
+    f_loaded.Lookup(x, J2);
+    e_loaded = max(e_loaded, (double)abs(J1 - J2).max());
+    h_table.Lookup(x, J1);
+    h_loaded.Lookup(x, J2);
+    e_loaded = max(e_loaded, (double)abs(J1 - J2).max());
+  }
+  ok = Check("Loaded table against the saved one", e_loaded, 0) && ok;
+
+  // The same measurements through both filters
+  Vehicle tabulated;
+  tabulated.InitSystem(4, 2, Q, R);
+  ok = Check("Tables rejected by the filter", !tabulated.UseJacobianTables(&f_loaded, &h_loaded), 0) && ok;
+
+  computed.InitSystemState(x0);
+  tabulated.InitSystemState(x0);
+  double e_filters = 0, e_estimate = 0;
+  for (int k = 0; k < n_steps; k++) {
+    computed.EKalmanf(u);
+    tabulated.EKalmanf(*computed.GetCurrentOutput(), u);
+
+    colvec x_true = *computed.GetCurrentState();
+    colvec x_computed = *computed.GetCurrentEstimatedState();
+    colvec x_tabulated = *tabulated.GetCurrentEstimatedState();
+    e_filters = max(e_filters, norm(x_computed.head(2) - x_tabulated.head(2)));
+    e_estimate = max(e_estimate, norm(x_computed.head(2) - x_true.head(2)));
+  }
+
+  // The interpolated Jacobians move the estimates by far less than their error
+  printf("Largest position error of the filter                 %10.3g\n", e_estimate);
+  ok = Check("Largest distance between the filters", e_filters, 0.01 * e_estimate) && ok;
+
+  // Misuses are reported
+  bool truncated = Truncate("jtable_f.bin", sizeof(double));
+  JacobianTable broken = f_loaded;
+  int n_accepted = !truncated + broken.Load("jtable_f.bin");
+  n_accepted += tabulated.UseJacobianTables(&h_loaded, 0);
+  n_accepted += tabulated.UseSensorJacobianTable(&f_loaded, 0);
+  n_accepted += (broken.GetNumberOfNodes() != f_loaded.GetNumberOfNodes());
+
+  colvec x_nan = x0;
+  x_nan(2) = datum::nan;
+  f_loaded.Lookup(x_nan, J1);
+  n_accepted += J1.is_finite();
+  ok = Check("Wrong tables, files and states accepted", n_accepted, 0) && ok;
+
+  remove("jtable_f.bin");
+  remove("jtable_h.bin");
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,245 @@
+/**
+ * @file main17.cpp
+ * @author agent
+ * @date 19 Oct 2026
+ *
+ * @brief Check the updates of an EKF with two sensors.
+ *
+ * @section DESCRIPTION
+ * A target moving at a constant velocity in the plane is seen by a radar at
+ * the origin, its range and bearing, and by a beacon that only measures its
+ * range. Both sensors report at every step, and the filter takes them one
+ * after the other with Update(z, sensor).
+ * The filter is compared to sequential single-sensor EKF updates written out
+ * with the analytic Jacobians. Each of them linearizes its sensor at the state
+ * left by the previous update, so the beacon sees the state the radar
+ * corrected. The filter must match them up to its finite differences, and be
+ * much farther from the same updates with both sensors linearized at the prior.
+ * Then the Jacobians are reused, SetRelinearizationPolicy, with the state
+ * threshold never reached, and an outlier is given to the radar. Its large
+ * normalized innovation must refresh the Jacobian of the beacon in the same
+ * step and the one of f in the next step. The same filter without the NIS
+ * threshold must not refresh them there.
+ * The program returns 1 if one of these checks fails.
+ */
+
+#include <stdio.h>
+
+#include "ekf.h"
+#include "check.h"
+
+/// @cond DEV
+/*
+ * States are the position and the velocity. The calls to f and h are
+ * counted, to tell when the filter computes a Jacobian.
+ */
+class Target: public EKF
+{
+public:
+  Target() {
+    n_f = 0;
+    n_h[0] = 0;
+    n_h[1] = 0;
+  }
+
+  virtual colvec f(const colvec& x, const colvec& u) {
+    n_f++;
+    return Motion(x);
+  }
+
+  virtual colvec h(const colvec& x) {
+    n_h[0]++;
+    return Radar(x);
+  }
+
+  virtual colvec h(const colvec& x, int sensor) {
+    if (sensor == 0)
+      return h(x);
+    n_h[1]++;
+    return Beacon(x);
+  }
+
+  static colvec Motion(const colvec& x) {
+    colvec xk = x;
+    xk(0) = x(0) + dt * x(2);
+    xk(1) = x(1) + dt * x(3);
+    return xk;
+  }
+
+  static colvec Radar(const colvec& x) {
+    colvec zk(2);
+    zk(0) = sqrt(x(0) * x(0) + x(1) * x(1));
+    zk(1) = atan2(x(1), x(0));
+    return zk;
+  }
+
+  static colvec Beacon(const colvec& x) {
+    colvec zk(1);
+    zk(0) = sqrt((x(0) - bx) * (x(0) - bx) + (x(1) - by) * (x(1) - by));
+    return zk;
+  }
+
+  static mat JacobianF() {
+    mat F = eye(4, 4);
+    F(0, 2) = dt;
+    F(1, 3) = dt;
+    return F;
+  }
+
+  static mat JacobianH(const colvec& x, int sensor) {
+    mat H(sensor == 0 ? 2 : 1, 4, fill::zeros);
+    if (sensor == 0) {
+      double r2 = x(0) * x(0) + x(1) * x(1);
+      H(0, 0) = x(0) / sqrt(r2);
+      H(0, 1) = x(1) / sqrt(r2);
+      H(1, 0) = -x(1) / r2;
+      H(1, 1) = x(0) / r2;
+    }
+    else {
+      double r = Beacon(x)(0);
+      H(0, 0) = (x(0) - bx) / r;
+      H(0, 1) = (x(1) - by) / r;
+    }
+    return H;
+  }
+
+  int n_f;     ///< Calls to f
+  int n_h[2];  ///< Calls to h, per sensor
+
+  static const double dt;
+  static const double bx;
+  static const double by;
+};
+
+const double Target::dt = 0.1;
+const double Target::bx = 60;
+const double Target::by = 60;
+
+/*
+ * The textbook EKF, one sensor at a time.
+ */
+struct Reference
+{
+  colvec x;
+  mat P;
+
+  void Predict(const mat& Q) {
+    mat F = Target::JacobianF();
+    x = Target::Motion(x);
+    P = F * P * trans(F) + Q;
+  }
+
+  void Update(const colvec& z, int sensor, const mat& R, const colvec& x_lin) {
+    mat H = Target::JacobianH(x_lin, sensor);
+    colvec y = z - (sensor == 0 ? Target::Radar(x) : Target::Beacon(x));
+    mat K = P * trans(H) * inv_sympd(H * P * trans(H) + R);
+    mat I_KH = eye(4, 4) - K * H;
+    x = x + K * y;
+    P = I_KH * P * trans(I_KH) + K * R * trans(K);
+  }
+};
+
+/// @endcond
+
+/////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv)
+{
+  const int n_steps = 200;
+  const int outlier_step = 120;
+
+  mat Q = diagmat(colvec({ 1e-4, 1e-4, 1e-3, 1e-3 }));
+  mat R0 = diagmat(colvec({ 0.25, 1e-4 }));
+  mat R1(1, 1);
+  R1(0, 0) = 0.04;
+  colvec x0({ 30, 10, 1, 2 });
+  colvec u(1, fill::zeros);
+
+  // Simulated target and measurements
+  arma_rng::set_seed(17);
+  mat X(4, n_steps), Z0(2, n_steps), Z1(1, n_steps);
+  colvec x = x0;
+  for (int k = 0; k < n_steps; k++) {
+    x = Target::Motion(x) + sqrt(Q) * randn<colvec>(4);
+    X.col(k) = x;
+    Z0.col(k) = Target::Radar(x) + sqrt(R0) * randn<colvec>(2);
+    Z1.col(k) = Target::Beacon(x) + sqrt(R1) * randn<colvec>(1);
+  }
+
+  bool ok = true;
+
+  // Both sensors at every step, against the sequential updates
+  Target filter;
+  filter.InitSystem(4, 2, Q, R0);
+  int beacon = filter.AddSensor(1, R1);
+  filter.InitSystemState(x0);
+
+  Reference relinearized = { x0, eye(4, 4) };
+  Reference at_prior = { x0, eye(4, 4) };
+  double e_relinearized = 0, e_at_prior = 0;
+  for (int k = 0; k < n_steps; k++) {
+    filter.Predict(u);
+    filter.Update(Z0.col(k), 0);
+    filter.Update(Z1.col(k), beacon);
+
+    relinearized.Predict(Q);
+    relinearized.Update(Z0.col(k), 0, R0, relinearized.x);
+    relinearized.Update(Z1.col(k), 1, R1, relinearized.x);
+
+    at_prior.Predict(Q);
+    colvec x_prior = at_prior.x;
+    at_prior.Update(Z0.col(k), 0, R0, x_prior);
+    at_prior.Update(Z1.col(k), 1, R1, x_prior);
+
+    colvec x_m = *filter.GetCurrentEstimatedState();
+    e_relinearized = max(e_relinearized, norm(x_m - relinearized.x));
+    e_at_prior = max(e_at_prior, norm(x_m - at_prior.x));
+  }
+
+  ok = Check("Distance to the sequential updates", e_relinearized, 1e-5) && ok;
+  ok = Check("Ratio to the distance to the updates at the prior", e_relinearized / e_at_prior, 0.01) && ok;
+
+  // Reused Jacobians. The state threshold is never reached, only the NIS
+  // threshold, the 99.9% quantile of the chi-square of 2 degrees of freedom,
+  // can refresh them
+  Target lazy[2];
+  for (int i = 0; i < 2; i++) {
+    lazy[i].InitSystem(4, 2, Q, R0);
+    lazy[i].AddSensor(1, R1);
+    lazy[i].InitSystemState(x0);
+    lazy[i].SetRelinearizationPolicy(1e9, 0, (i == 0) ? 13.8 : 0);
+  }
+
+  // Per step, 1 if the Jacobian of f, of the radar and of the beacon was computed
+  imat refreshed[2];
+  for (int i = 0; i < 2; i++) {
+    refreshed[i].zeros(n_steps, 3);
+    for (int k = 0; k < n_steps; k++) {
+      colvec z0 = Z0.col(k);
+      if (k == outlier_step)
+        z0(0) = z0(0) + 10;
+
+      int n_f = lazy[i].n_f;
+      int n_h[2] = { lazy[i].n_h[0], lazy[i].n_h[1] };
+      lazy[i].Predict(u);
+      lazy[i].Update(z0, 0);
+      lazy[i].Update(Z1.col(k), beacon);
+
+      // One call for the prediction, two per update, and more for a Jacobian
+      refreshed[i](k, 0) = (lazy[i].n_f - n_f > 1);
+      refreshed[i](k, 1) = (lazy[i].n_h[0] - n_h[0] > 2);
+      refreshed[i](k, 2) = (lazy[i].n_h[1] - n_h[1] > 2);
+    }
+  }
+
+  printf("Jacobians computed with the NIS threshold, f %d, radar %d, beacon %d, in %d steps\n",
+      (int)accu(refreshed[0].col(0)), (int)accu(refreshed[0].col(1)),
+      (int)accu(refreshed[0].col(2)), n_steps);
+  int n_missed = !refreshed[0](outlier_step, 2) + !refreshed[0](outlier_step + 1, 0);
+  int n_unexpected = refreshed[1](outlier_step, 2) + refreshed[1](outlier_step + 1, 0);
+  ok = Check("Refreshes missed after the outlier", n_missed, 0) && ok;
+  ok = Check("Refreshes without the NIS threshold", n_unexpected, 0) && ok;
+  ok = Check("Jacobians of f computed", accu(refreshed[0].col(0)), n_steps / 2) && ok;
+
+  return ok ? 0 : 1;
+}
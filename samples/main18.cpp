@@ -0,0 +1,174 @@
+/**
+ * @file main18.cpp
+ * @author agent
+ * @date 19 Oct 2026
+ *
+ * @brief Check the reuse of the Jacobians of the EKF, SetRelinearizationPolicy.
+ *
+ * @section DESCRIPTION
+ * A vehicle drives at a constant speed, seen by its range and bearing
+ * from the origin. One EKF computes its Jacobians at every step, another one
+ * reuses them until the estimated heading moves more than an angle from where
+ * they were computed, or until they are a number of steps old. The vehicle
+ * turns for the first half of the run, so the heading trips first, and then
+ * goes straight, so the age trips. Both filters get the same measurements.
+ * The calls to f and h are counted to tell when a Jacobian is computed, and
+ * the sample follows the operating points itself. The program returns 1 if one
+ * of these checks fails:
+ * - a Jacobian is computed exactly when the heading or the age trips, and both trip,
+ * - the Jacobian of f is reused in most of the steps,
+ * - the estimates of both filters stay close, compared to their error.
+ */
+
+#include <stdio.h>
+
+#include "ekf.h"
+#include "check.h"
+
+/// @cond DEV
+/*
+ * States are the position, the heading and the speed, the input is the yaw
+ * rate. The calls to f and h are counted.
+ */
+class Vehicle: public EKF
+{
+public:
+  Vehicle() {
+    n_f = 0;
+    n_h = 0;
+  }
+
+  virtual colvec f(const colvec& x, const colvec& u) {
+    n_f++;
+    colvec xk(4);
+    xk(0) = x(0) + dt * x(3) * cos(x(2));
+    xk(1) = x(1) + dt * x(3) * sin(x(2));
+    xk(2) = x(2) + dt * u(0);
+    xk(3) = x(3);
+    return xk;
+  }
+
+  virtual colvec h(const colvec& x) {
+    n_h++;
+    colvec zk(2);
+    zk(0) = sqrt(x(0) * x(0) + x(1) * x(1));
+    zk(1) = atan2(x(1), x(0));
+    return zk;
+  }
+
+  int n_f;  ///< Calls to f
+  int n_h;  ///< Calls to h
+
+  static const double dt;
+};
+
+const double Vehicle::dt = 0.1;
+
+/*
+ * The policy of the filter, written out: a Jacobian is stale once it moved
+ * more than the threshold from its operating point, in the norm of W, or
+ * reached the maximum age.
+ */
+struct OperatingPoint
+{
+  colvec x;
+  int steps;
+  int n_moved;
+  int n_aged;
+
+  bool IsStale(const colvec& x_now, const mat& W, double threshold, int max_steps) {
+    if (x.is_empty())
+      return true;
+    colvec dx = x_now - x;
+    bool moved = sqrt(dot(dx, W * dx)) > threshold;
+    bool aged = steps >= max_steps;
+    n_moved += moved;
+    n_aged += aged && !moved;
+    return moved || aged;
+  }
+};
+
+/// @endcond
+
+/////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv)
+{
+  const int n_steps = 300;
+  const double threshold = 0.1;
+  const int max_steps = 8;
+
+  mat Q = diagmat(colvec({ 1e-4, 1e-4, 1e-4, 1e-3 }));
+  mat R = diagmat(colvec({ 0.25, 1e-4 }));
+
+  // An arc of radius 20 m, then straight on
+  colvec x0({ 65, 45, M_PI / 2, 4 });
+  colvec u(1);
+
+  Vehicle always, lazy;
+  always.InitSystem(4, 2, Q, R);
+  always.InitSystemState(x0);
+  lazy.InitSystem(4, 2, Q, R);
+  lazy.InitSystemState(x0);
+  lazy.SetRelinearizationPolicy(threshold, max_steps, 0);
+
+  // Only the heading counts, in radians
+  mat W(4, 4, fill::zeros);
+  W(2, 2) = 1;
+  lazy.SetRelinearizationNorm(W);
+
+  OperatingPoint f_lin = { colvec(), 0, 0, 0 }, h_lin = { colvec(), 0, 0, 0 };
+  int n_f_computed = 0, n_h_computed = 0, n_mismatches = 0;
+  double e_filters = 0, e_estimate = 0;
+
+  for (int k = 0; k < n_steps; k++) {
+    u(0) = (k < n_steps / 2) ? 0.2 : 0;
+    always.EKalmanf(u);
+
+    // F is computed at the estimate before the prediction, H at the prior
+    colvec x_before = *lazy.GetCurrentEstimatedState();
+    int n_f = lazy.n_f;
+    lazy.Predict(u);
+    colvec x_prior = *lazy.GetCurrentEstimatedState();
+    int n_h = lazy.n_h;
+    lazy.Update(*always.GetCurrentOutput(), 0);
+
+    // One call to f for the prediction, two to h for the update, and more for a Jacobian
+    bool f_computed = (lazy.n_f - n_f > 1);
+    bool h_computed = (lazy.n_h - n_h > 2);
+
+    n_mismatches += (f_computed != f_lin.IsStale(x_before, W, threshold, max_steps));
+    n_mismatches += (h_computed != h_lin.IsStale(x_prior, W, threshold, max_steps));
+    if (f_computed) {
+      f_lin.x = x_before;
+      f_lin.steps = 0;
+      n_f_computed++;
+    }
+    if (h_computed) {
+      h_lin.x = x_prior;
+      h_lin.steps = 0;
+      n_h_computed++;
+    }
+    f_lin.steps++;
+    h_lin.steps++;
+
+    colvec x_true = *always.GetCurrentState();
+    colvec x_always = *always.GetCurrentEstimatedState();
+    colvec x_lazy = *lazy.GetCurrentEstimatedState();
+    e_filters = max(e_filters, norm(x_always.head(2) - x_lazy.head(2)));
+    e_estimate = max(e_estimate, norm(x_always.head(2) - x_true.head(2)));
+  }
+
+  printf("Jacobians computed, f %d, h %d, in %d steps\n", n_f_computed, n_h_computed, n_steps);
+  printf("Tripped by the heading %d, by the age %d\n",
+      f_lin.n_moved + h_lin.n_moved, f_lin.n_aged + h_lin.n_aged);
+  printf("Largest position error of the filter                 %10.3g\n", e_estimate);
+
+  bool ok = true;
+  ok = Check("Steps that do not follow the policy", n_mismatches, 0) && ok;
+  ok = Check("Triggers that never tripped", (f_lin.n_moved == 0) + (f_lin.n_aged == 0), 0) && ok;
+  ok = Check("Jacobians of f computed", n_f_computed, n_steps / 2) && ok;
+  ok = Check("Largest distance between the filters", e_filters, 0.1 * e_estimate) && ok;
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+/**
+ * @file main19.cpp
+ * @author agent
+ * @date 19 Oct 2026
+ *
+ * @brief Check the second order EKF on a partly linear model.
+ *
+ * @section DESCRIPTION
+ * A pendulum is seen by the horizontal position of its tip and by an angle
+ * sensor with a slowly drifting bias. Only the angular velocity in f and the
+ * tip position in h are nonlinear, and only in the angle. One EKF2 is told so,
+ * with SetLinearComponents and SetNonlinearStates, and skips the other
+ * Hessians. Another one computes all of them. Both get the same measurements.
+ * The Hessians it skips are zero, so the program returns 1 if the estimates of
+ * both filters are not the same, up to the finite differences, or if the
+ * declared filter does not call f and h fewer times.
+ */
+
+#include <stdio.h>
+
+#include "ekf2.h"
+#include "check.h"
+
+/// @cond DEV
+/*
+ * States are the angle, the angular velocity and the bias of the angle
+ * sensor. The calls to f and h are counted.
+ */
+class Pendulum: public EKF2
+{
+public:
+  Pendulum() {
+    n_calls = 0;
+  }
+
+  virtual colvec f(const colvec& x, const colvec& u) {
+    n_calls++;
+    colvec xk(3);
+    xk(0) = x(0) + dt * x(1);
+    xk(1) = x(1) - dt * 9.81 / length * sin(x(0));
+    xk(2) = x(2);
+    return xk;
+  }
+
+  virtual colvec h(const colvec& x) {
+    n_calls++;
+    colvec zk(2);
+    zk(0) = length * sin(x(0));
+    zk(1) = x(0) + x(2);
+    return zk;
+  }
+
+  int n_calls;  ///< Calls to f and h
+
+  static const double dt;
+  static const double length;
+};
+
+const double Pendulum::dt = 0.01;
+const double Pendulum::length = 0.5;
+
+/// @endcond
+
+/////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv)
+{
+  const int n_steps = 1000;
+
+  mat Q = diagmat(colvec({ 1e-6, 1e-4, 1e-8 }));
+  mat R = diagmat(colvec({ 1e-4, 1e-4 }));
+  mat P0 = diagmat(colvec({ 1e-2, 1e-2, 1e-2 }));
+  colvec x0({ 1.0, 0, 0.05 });
+  colvec u(1, fill::zeros);
+
+  Pendulum full, declared;
+  full.InitSystem(3, 2, Q, R);
+  full.InitSystemState(x0);
+  full.InitSystemStateCovariance(P0);
+  declared.InitSystem(3, 2, Q, R);
+  declared.InitSystemState(x0);
+  declared.InitSystemStateCovariance(P0);
+
+  // f(0), f(2) and h(1) are linear, and everything only bends with the angle
+  declared.SetLinearComponents(uvec({ 0, 2 }), uvec({ 1 }));
+  declared.SetNonlinearStates(uvec({ 0 }));
+
+  double e_filters = 0, e_estimate = 0;
+  for (int k = 0; k < n_steps; k++) {
+    full.EKalmanf(u);
+    declared.EKalmanf(*full.GetCurrentOutput(), u);
+
+    colvec x_true = *full.GetCurrentState();
+    colvec x_full = *full.GetCurrentEstimatedState();
+    colvec x_declared = *declared.GetCurrentEstimatedState();
+    e_filters = max(e_filters, (double)abs(x_full - x_declared).max());
+    e_estimate = e_estimate + accu(square(x_full - x_true)) / (3 * n_steps);
+  }
+
+  printf("Calls to f and h, all Hessians %d, declared %d\n", full.n_calls, declared.n_calls);
+  e_estimate = sqrt(e_estimate);
+  printf("RMS error of the estimates                           %10.3g\n", e_estimate);
+
+  bool ok = true;
+  ok = Check("Largest distance between the filters", e_filters, 1e-2 * e_estimate) && ok;
+  ok = Check("Calls of the declared filter, relative", (double)declared.n_calls / full.n_calls, 0.6) && ok;
+
+  return ok ? 0 : 1;
+}
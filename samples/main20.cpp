@@ -0,0 +1,155 @@
+/**
+ * @file main20.cpp
+ * @author agent
+ * @date 19 Oct 2026
+ *
+ * @brief Example for the filters with the model bound at compile time.
+ *
+ * @section DESCRIPTION
+ * The random sine signal of samples 8 and 11 is tracked by an EKF and a UKF,
+ * once with the derived-class API, where f and h are virtual functions, and
+ * once with EKFT and UKFT, where the model is given as a template parameter
+ * and its f and h are called without virtual dispatch in the Jacobians and
+ * the sigma points. Both forms get the same measurements, and the time of a
+ * step is printed for each.
+ * The program returns 1 if the estimates of both forms are not the same.
+ */
+
+#include <stdio.h>
+#include <chrono>
+
+#include "ekf.h"
+#include "ukf.h"
+#include "check.h"
+
+/// @cond DEV
+/*
+ * The model, written once with the in-place f and h. It is put on top of the
+ * filter it is given: EKF or UKF for the derived-class API, EKFT or UKFT of
+ * the final class for the compile-time binding.
+ */
+template <class Filter>
+class Sine : public Filter
+{
+public:
+  void f(const colvec& x, const colvec& u, colvec& xk) {
+    xk.set_size(3);
+    xk(0) = x(0) + dt * x(1);
+    xk(1) = x(1);
+    xk(2) = x(2);
+  }
+
+  void h(const colvec& x, colvec& zk) {
+    zk.set_size(1);
+    zk(0) = x(2) * sin(x(0));
+  }
+
+  static const double dt;
+};
+
+template <class Filter>
+const double Sine<Filter>::dt = 0.01;
+
+/*
+ * EKFT and UKFT take the final class as their template parameter.
+ */
+class SineEKFT : public Sine<EKFT<SineEKFT> > {};
+class SineUKFT : public Sine<UKFT<SineUKFT> > {};
+
+/*
+ * A step of either filter.
+ */
+void Step(EKF& filter, const colvec& z, const colvec& u)
+{
+  filter.EKalmanf(z, u);
+}
+
+void Step(UKF& filter, const colvec& z, const colvec& u)
+{
+  filter.UKalmanf(z, u);
+}
+
+/*
+ * Run a filter over the measurements, keep its estimates and return the time
+ * of a step, in microseconds.
+ */
+template <class Filter>
+double Run(Filter& filter, const mat& Z, mat& X_m)
+{
+  colvec u(1, fill::zeros);
+  X_m.set_size(3, Z.n_cols);
+
+  auto start = std::chrono::steady_clock::now();
+  for (uword k = 0; k < Z.n_cols; k++) {
+    Step(filter, Z.col(k), u);
+    X_m.col(k) = *filter.GetCurrentEstimatedState();
+  }
+  std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / Z.n_cols;
+}
+
+/*
+ * Set up a filter like sample 8.
+ */
+template <class Filter>
+void Init(Filter& filter)
+{
+  double q1 = 0.2;
+  double q2 = 0.1;
+  double dt = Sine<EKF>::dt;
+
+  mat Q(3, 3);
+  Q << q1*dt*dt*dt/3 << q1*dt*dt/2 << 0     << endr
+    << q1*dt*dt/2    << q1*dt      << 0     << endr
+    << 0             << 0          << dt*q2 << endr;
+  mat R = eye(1, 1);
+  colvec x0({ 0, 10, 1 });
+
+  filter.InitSystem(3, 1, Q, R);
+  filter.InitSystemState(x0);
+  filter.InitSystemStateCovariance(3 * eye(3, 3));
+}
+
+/// @endcond
+
+/////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv)
+{
+  const int n_steps = 2000;
+
+  // Simulated measurements
+  Sine<EKF> simulation;
+  Init(simulation);
+  colvec u(1, fill::zeros);
+  mat Z(1, n_steps);
+  for (int k = 0; k < n_steps; k++) {
+    simulation.EKalmanf(u);
+    Z.col(k) = *simulation.GetCurrentOutput();
+  }
+
+  Sine<EKF> ekf;
+  SineEKFT ekft;
+  Sine<UKF> ukf;
+  SineUKFT ukft;
+  Init(ekf);
+  Init(ekft);
+  Init(ukf);
+  Init(ukft);
+
+  mat X_ekf, X_ekft, X_ukf, X_ukft;
+  double t_ekf = Run(ekf, Z, X_ekf);
+  double t_ekft = Run(ekft, Z, X_ekft);
+  double t_ukf = Run(ukf, Z, X_ukf);
+  double t_ukft = Run(ukft, Z, X_ukft);
+
+  printf("Time of a step, in microseconds\n");
+  printf("EKF  virtual %8.2f, compile time %8.2f\n", t_ekf, t_ekft);
+  printf("UKF  virtual %8.2f, compile time %8.2f\n", t_ukf, t_ukft);
+
+  bool ok = true;
+  ok = Check("Largest distance between the EKFs", abs(X_ekf - X_ekft).max(), 1e-12) && ok;
+  ok = Check("Largest distance between the UKFs", abs(X_ukf - X_ukft).max(), 1e-12) && ok;
+
+  return ok ? 0 : 1;
+}
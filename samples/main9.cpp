@@ -8,6 +8,7 @@
  */
 
 #include "fx.h"
+#include "fxt.h"
 
 
 colvec foo(colvec &x, colvec &a)
@@ -32,8 +33,32 @@ int main(int argc, char** argv)
     mat jac = f.JacobianAt(x, a);
     mat hess = f.HessianAt(x, a, 0);
 
+    // All Hessians at once, on two threads
+    cube hess_all;
+    f.SetThreads(2);
+    f.HessianAt(x, a, hess_all);
+
     y.print("y");
     jac.print("jac");
     hess.print("hess");
+    hess_all.print("hess_all");
+
+    // Jacobian to a given accuracy, with its error estimate
+    f.SetTolerance(1e-8);
+    mat jac_tol = f.JacobianAt(x, a);
+    jac_tol.print("jac_tol");
+    cout << "jac_tol error estimate: " << f.GetErrorEstimate() << endl;
+
+    // The same function as a lambda, writing its result in place
+    double gain = 2.0;
+    auto bar = [gain](const colvec &x, const colvec &c, colvec &out) {
+        out.set_size(1);
+        out(0) = gain * x(0) * x(1) * x(2);
+    };
+    FXT<decltype(bar)> g(bar);
+
+    mat jac_g;
+    g.JacobianAt(x, a, jac_g);
+    jac_g.print("jac_g");
     return 0;
 }